@@ -11,6 +11,12 @@ int main()
     OCR1A = TARGET_TIMER_COUNT; // Set CTC compare value (prescaler = 256)
     TCCR1B |= (1 << CS12);      // Start timer at (F_CPU / 256) - prescaler = 256
 
-    while (1) {                 // Ensure program keeps running
+    ADCSRA &= ~(1 << ADEN);     // Only Timer1 is used : cut the clock of everything else
+    PRR = (1 << PRTWI) | (1 << PRTIM2) | (1 << PRTIM0)
+        | (1 << PRSPI) | (1 << PRUSART0) | (1 << PRADC);
+    SMCR = (1 << SE);           // Idle mode : CPU stopped, Timer1 still toggles OC1A in hardware
+    while (1) {                 // No interrupt enabled, nothing wakes the CPU : asleep 100% of
+                                // the time, so this image needs no SLEEP_STATS measurement
+        __asm__ __volatile__ ("sleep");
     }
 }
\ No newline at end of file
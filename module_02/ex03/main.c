@@ -3,12 +3,28 @@
 #include <avr/interrupt.h>
 
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))     // Round to nearest integer
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
 
 void uart_init(unsigned int ubrr) {
     UBRR0H = (unsigned char)(ubrr >> 8);    // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)ubrr;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
     
     UCSR0B = (1 << RXEN0) | (1 << TXEN0)    // Enable receiver & transmitter
         | (1 << RXCIE0);                    // Enable RX Complete  interrupt
@@ -5,8 +5,23 @@
 #define TOP (F_CPU / 256) - 1
 
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
 
 #define RED     "\e[1;31m"
 #define GREEN   "\e[1;32m"
@@ -24,6 +39,7 @@ int bad_input = 0;
 void uart_init(unsigned int ubrr) {
     UBRR0H = (unsigned char)(ubrr >> 8);    // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)ubrr;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
     
     UCSR0B = (1 << RXEN0) | (1 << TXEN0)    // Enable receiver & transmitter
         | (1 << RXCIE0);                    // Enable RX Complete interrupt
@@ -110,7 +126,96 @@ void handle_enter()
     i = 0;
 }
 
-ISR(USART_RX_vect) {  
+// ******************************************************************** IDLE */
+// Everything happens in USART_RX_vect : main sleeps in Idle mode (CPU & flash clocks off, the
+// USART keeps running & wakes it up). No timer, TWI, SPI or ADC here : all cut in PRR.
+// SLEEP_STATS 1 : Timer1 (clk/256, 16us) timestamps each sleep, USART_RX_vect closes it with
+// SLEEP_WAKE() & "asleep N%" is printed every second.
+#define SLEEP_STATS     0
+#define STATS_TICKS     62500UL             // 1s of Timer1 at clk/256
+
+void power_init(void) {
+    ADCSRA &= ~(1 << ADEN);                 // ADC off before its clock is cut
+    PRR = (1 << PRTWI) | (1 << PRTIM2) | (1 << PRTIM1) | (1 << PRTIM0) | (1 << PRSPI) | (1 << PRADC);
+#if SLEEP_STATS
+    PRR &= ~(1 << PRTIM1);
+#endif
+}
+
+#if SLEEP_STATS
+volatile uint16_t stats_ovf = 0;
+volatile uint8_t sleeping = 0;
+volatile uint32_t sleep_ticks = 0;          // Time asleep in the current report period
+uint32_t sleep_start = 0;
+uint32_t stats_start = 0;
+
+uint32_t stats_now(void) {                  // Timer1 ticks, interrupts disabled
+    uint16_t count = TCNT1;
+    uint16_t ovf = stats_ovf;
+    if ((TIFR1 & (1 << TOV1)) && count < 0xFFFF)
+        ovf++;                              // Overflow pending : not counted yet
+    return (((uint32_t)ovf << 16) | count);
+}
+
+void sleep_wake(void) {
+    if (sleeping) {
+        sleep_ticks += stats_now() - sleep_start;
+        sleeping = 0;
+    }
+}
+#define SLEEP_WAKE() sleep_wake()
+
+ISR(TIMER1_OVF_vect) {                      // Once per second : its few cycles count as asleep
+    stats_ovf++;
+}
+
+void stats_init(void) {
+    TCCR1B = (1 << CS12);                   // Normal mode, prescaler 256
+    TIMSK1 = (1 << TOIE1);
+}
+
+void stats_report(void) {
+    cli();
+    sleep_wake();
+    uint32_t total = stats_now() - stats_start;
+    uint32_t asleep = sleep_ticks;
+    if (total >= STATS_TICKS) {
+        stats_start += total;
+        sleep_ticks = 0;
+    }
+    sei();
+    if (total < STATS_TICKS)
+        return ;
+    uint8_t pct = asleep * 100 / total;
+    uart_printstr("asleep ");
+    if (pct >= 100)
+        uart_tx('1');
+    if (pct >= 10)
+        uart_tx('0' + pct / 10 % 10);
+    uart_tx('0' + pct % 10);
+    uart_printstr("%\r\n");
+}
+#else
+#define SLEEP_WAKE()
+#endif
+
+void idle(void) {                           // Returns after the next interrupt
+    cli();
+#if SLEEP_STATS
+    sleep_start = stats_now();
+    sleeping = 1;
+#endif
+    SMCR = (1 << SE);                       // SM2:0 = 000 : Idle mode
+    sei();                                  // sei always executes the next instruction first :
+    __asm__ __volatile__ ("sleep");         // no interrupt can slip in before the sleep
+    SMCR = 0;
+#if SLEEP_STATS
+    stats_report();
+#endif
+}
+
+ISR(USART_RX_vect) {
+    SLEEP_WAKE();
     char c = UDR0;                          // Read received data
     if (c == 0x7F || c == 0x08)             // Handle backspace
         handle_backspace();
@@ -129,12 +234,16 @@ ISR(USART_RX_vect) {
 int main() {
     DDRB |= (1 << PB0) | (1 << PB1) | (1 << PB2) | (1 << PB4);
 
+    power_init();
     uart_init(MYUBRR);
     uart_printstr(prompt);
     uart_printstr("\033[2;11H");
+#if SLEEP_STATS
+    stats_init();
+#endif
     sei();
 
     while (1)
-        ;
+        idle();
     return (0);
 }
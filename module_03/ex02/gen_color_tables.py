@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# Generates the COLOR section tables shared by the RGB exercises
+# (module_03/ex02, module_05/ex04, module_08/ex04, module_08/spi_bench) :
+# - gamma8[]      : perceptual correction, 8-bit in / 8-bit out (module_08 only)
+# - wheel_table[] : the old wheel() arithmetic, one RGB triplet per position
+# - gamma16_table[]: same curve with 16-bit output, for the dithered / 16-bit PWM
+#                    drivers (--gamma16, module_03/ex02 & module_05/ex04, which
+#                    use it instead of gamma8[])
+# Each exercise builds alone (SRC = main.c), so the output is pasted into every
+# main.c : edit & re-run this script instead of editing the copies by hand.
+#
+#   python3 gen_color_tables.py           -> C tables on stdout, checks on stderr
+#   python3 gen_color_tables.py --gamma16 -> gamma16_table[] only
+
+import sys
+
+GAMMA = 2.8                 # LED brightness is roughly linear in duty cycle, the eye is not
+
+
+def gamma8():
+    return [round(((i / 255.0) ** GAMMA) * 255) for i in range(256)]
+
+
+def gamma16():
+    return [round(((i / 255.0) ** GAMMA) * 65535) for i in range(256)]
+
+
+def wheel(pos):
+    """Same output as the former wheel() : red -> purple -> green -> red."""
+    pos = 255 - pos
+    if pos < 85:
+        return (255 - pos * 3, 0, pos * 3)
+    if pos < 170:
+        pos -= 85
+        return (0, pos * 3, 255 - pos * 3)
+    pos -= 170
+    return (pos * 3, 255 - pos * 3, 0)
+
+
+def hsv_to_rgb(h, s, v):
+    """Same integer math as hsv_to_rgb() in main.c."""
+    if s == 0:
+        return (v, v, v)
+    region = (h * 6) >> 8
+    rem = (h * 6) & 0xFF
+    p = (v * (255 - s)) >> 8
+    q = (v * (255 - ((s * rem) >> 8))) >> 8
+    t = (v * (255 - ((s * (255 - rem)) >> 8))) >> 8
+    return [(v, t, p), (q, v, p), (p, v, t), (p, q, v), (t, p, v), (v, p, q)][region]
+
+
+def rows(values, per_row, fmt):
+    out = []
+    for i in range(0, len(values), per_row):
+        row = ", ".join(fmt % v for v in values[i:i + per_row])
+        out.append("    " + row + ("," if i + per_row < len(values) else ""))
+    return out
+
+
+def main():
+    if "--gamma16" in sys.argv[1:]:
+        g16 = gamma16()
+        print("// Generated by module_03/ex02/gen_color_tables.py --gamma16 : gamma %.1f" % GAMMA)
+        print("const uint16_t gamma16_table[256] PROGMEM = {")
+        print("\n".join(rows(g16, 8, "%5d")))
+        print("};")
+        ok = all(g16[i] <= g16[i + 1] for i in range(255)) and g16[255] == 65535
+        sys.stderr.write("checks %s : %d distinct levels (gamma8 : %d)\n"
+                         % ("ok" if ok else "FAILED", len(set(g16)), len(set(gamma8()))))
+        return 0 if ok else 1
+
+    g = gamma8()
+    print("// Generated by module_03/ex02/gen_color_tables.py : gamma %.1f" % GAMMA)
+    print("const uint8_t gamma8_table[256] PROGMEM = {")
+    print("\n".join(rows(g, 16, "%3d")))
+    print("};")
+    print("")
+    print("const uint8_t wheel_table[256][3] PROGMEM = {")
+    w = ["{%3d, %3d, %3d}" % wheel(p) for p in range(256)]
+    print("\n".join(rows(w, 4, "%s")))
+    print("};")
+
+    # Checks : monotonic gamma, HSV at full saturation hits the primaries
+    ok = all(g[i] <= g[i + 1] for i in range(255)) and g[0] == 0 and g[255] == 255
+    ok &= hsv_to_rgb(0, 255, 255) == (255, 0, 0)
+    ok &= max(max(hsv_to_rgb(h, 255, 255)) for h in range(256)) == 255
+    ok &= all(hsv_to_rgb(h, 0, 200) == (200, 200, 200) for h in range(256))
+    sys.stderr.write("checks %s\n" % ("ok" if ok else "FAILED"))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
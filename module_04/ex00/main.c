@@ -3,9 +3,111 @@
 #include <avr/interrupt.h>
 
 #define SW1 PD2
+#define DEBOUNCE_MS 16                      // Former Timer0 overflow : 1024 * 256 / 16MHz
 
 volatile uint8_t button_pressed = 0;
 
+// ************************************************************** TIMER WHEEL */
+// Software timeouts on a single 1ms Timer1 tick : Timer0 & Timer2 stay free for PWM.
+// Hashed wheel of WHEEL_SLOTS lists : a timeout of `ms` goes in slot (now + ms) % WHEEL_SLOTS
+// with `rounds` = full turns to wait. Start / stop are O(1) list operations, a tick only
+// walks the current slot. swtimer_t is owned by the caller : no limit on the count.
+// Callbacks run from TIMER1_COMPA_vect and may start / stop any timer, themselves included.
+// The tick is stopped while no timer is armed.
+#define TOP_TIMER1  (F_CPU / 64UL / 1000 - 1)   // 1ms tick = 249
+#define WHEEL_SHIFT 4
+#define WHEEL_SLOTS (1 << WHEEL_SHIFT)
+#define WHEEL_MASK  (WHEEL_SLOTS - 1)
+#define WHEEL_IDLE  0xFF                    // swtimer_t.slot : not armed
+#define WHEEL_DUE   0xFE                    // swtimer_t.slot : expired this tick, not fired yet
+
+typedef struct swtimer_s {
+    struct swtimer_s *next;
+    struct swtimer_s *prev;
+    void (*fn)(void);
+    uint16_t rounds;                        // Full wheel turns left
+    uint8_t slot;                           // Wheel slot, WHEEL_IDLE or WHEEL_DUE
+} swtimer_t;
+
+swtimer_t *wheel[WHEEL_SLOTS];
+uint8_t wheel_pos = 0;                      // Slot of the last tick
+uint16_t wheel_armed = 0;
+
+void wheel_unlink(swtimer_t *t, uint8_t slot) {
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        wheel[slot] = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    t->slot = WHEEL_IDLE;
+    if (--wheel_armed == 0)
+        TCCR1B &= ~((1 << CS11) | (1 << CS10)); // Nothing left : stop the tick
+}
+
+void swtimer_init(swtimer_t *t) {
+    t->slot = WHEEL_IDLE;
+}
+
+void swtimer_stop(swtimer_t *t) {
+    uint8_t sreg = SREG;
+    cli();
+    if (t->slot == WHEEL_DUE)
+        wheel_unlink(t, wheel_pos);
+    else if (t->slot != WHEEL_IDLE)
+        wheel_unlink(t, t->slot);
+    SREG = sreg;
+}
+
+void swtimer_start(swtimer_t *t, uint16_t ms, void (*fn)(void)) {  // Fires once after ms
+    uint8_t sreg = SREG;
+    cli();
+    swtimer_stop(t);                        // Restart if already armed
+    if (ms == 0)
+        ms = 1;
+    uint8_t slot = (wheel_pos + ms) & WHEEL_MASK;
+    t->fn = fn;
+    t->rounds = (ms - 1) >> WHEEL_SHIFT;
+    t->slot = slot;
+    t->prev = 0;
+    t->next = wheel[slot];
+    if (t->next)
+        t->next->prev = t;
+    wheel[slot] = t;
+    if (wheel_armed++ == 0) {
+        TCNT1 = 0;                          // Full first tick
+        TCCR1B |= (1 << CS11) | (1 << CS10);    // Prescaler 64 : start the tick
+    }
+    SREG = sreg;
+}
+
+void wheel_init(void) {
+    TCCR1B = (1 << WGM12);                  // CTC Mode, TOP = OCR1A, stopped until a timer starts
+    OCR1A = TOP_TIMER1;
+    TIMSK1 |= (1 << OCIE1A);                // Enable Timer1 Compare Match A Interrupt
+}
+
+ISR(TIMER1_COMPA_vect) {
+    wheel_pos = (wheel_pos + 1) & WHEEL_MASK;
+    for (swtimer_t *t = wheel[wheel_pos]; t; t = t->next) {
+        if (t->rounds)
+            t->rounds--;
+        else
+            t->slot = WHEEL_DUE;            // Marked first : callbacks may edit the list
+    }
+    while (1) {
+        swtimer_t *t = wheel[wheel_pos];
+        while (t && t->slot != WHEEL_DUE)
+            t = t->next;
+        if (!t)
+            break;
+        wheel_unlink(t, wheel_pos);
+        t->fn();
+    }
+}
+
+swtimer_t debounce;
+
 void init_io() {
     DDRB |= (1 << PB0);                     // Set LED D5 as output
     DDRD &= ~((1 << DDD2));                 // Enable input for PD2
@@ -19,17 +121,7 @@ void init_interrupts() {
     sei();                                  // Enable global interrupts
 }
 
-ISR(INT0_vect) {                            // Interrupt for INT0 - button press
-    EIMSK &= ~(1 << INT0);                  // Disable INT0 to prevent multiple triggers
-    TCCR0B |= (1 << CS02) | (1 << CS00);    // Set Timer0 prescaler to 1024 for debounce
-    TCNT0 = 0;                              // Reset Timer0
-    TIMSK0 |= (1 << TOIE0);                 // Enable Timer0 overflow interrupt
-}
-
-ISR(TIMER0_OVF_vect) {
-    TIMSK0 &= ~(1 << TOIE0);                // Disable Timer0 interrupt
-    TCCR0B &= ~((1 << CS02) | (1 << CS00)); // Stop Timer0
-
+void debounce_done(void) {                  // Called by the wheel DEBOUNCE_MS after the edge
     button_pressed ^= 1;
     if (button_pressed == 1)
         PORTB ^= (1 << PB0);                // Toggle LED if button pressed
@@ -38,9 +130,16 @@ ISR(TIMER0_OVF_vect) {
     EIMSK |= (1 << INT0);                   // Re-enable INT0
 }
 
+ISR(INT0_vect) {                            // Interrupt for INT0 - button press
+    EIMSK &= ~(1 << INT0);                  // Disable INT0 to prevent multiple triggers
+    swtimer_start(&debounce, DEBOUNCE_MS, debounce_done);
+}
+
 int main()
 {
     init_io();
+    wheel_init();
+    swtimer_init(&debounce);
     init_interrupts();
     while (1)
         ;
@@ -5,6 +5,25 @@
 #define TOP_TIMER0 (F_CPU / 1024UL / 100)     // 10ms interrupt period = 156.25
 #define TOP_TIMER1 (F_CPU / (256UL * 500))    // 500Hz PWM frequency (500 overflows/s)
 
+#define UART_BAUDRATE 115200                // SLEEP_STATS output
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
+
 // ************************************************************* TIMER SETUP */
 void setup_timer1() {
    DDRB |= (1 << PB1);                      // Set PB1 output (LED)
@@ -21,8 +40,94 @@ void setup_timer0() {
     TIMSK0 |= (1 << OCIE0A);                // Enable Timer0 Compare Match A Interrupt
 }
 
+// ******************************************************************** IDLE */
+// The Timer1 PWM runs on its own & Timer0 updates it every 10ms : in between main sleeps in
+// Idle mode (CPU & flash clocks off, both timers keep running). Everything else : PRR.
+// SLEEP_STATS 1 : each sleep is timestamped from the Timer0 tick (64us counts) & closed when
+// idle() returns (the Timer0 ISR is a few us, counted as asleep), "asleep N%" over UART
+// every STATS_TICKS.
+#define SLEEP_STATS     0
+#define STATS_TICKS     100                 // Timer0 ticks per report (~1s)
+
+void power_init(void) {
+    ADCSRA &= ~(1 << ADEN);                 // ADC off before its clock is cut
+    PRR = (1 << PRTWI) | (1 << PRTIM2) | (1 << PRSPI) | (1 << PRUSART0) | (1 << PRADC);
+#if SLEEP_STATS
+    PRR &= ~(1 << PRUSART0);
+#endif
+}
+
+#if SLEEP_STATS
+volatile uint32_t stats_tick = 0;           // Timer0 ticks, from TIMER0_COMPA_vect
+uint32_t sleep_counts = 0;                  // Time asleep in the current report period
+uint32_t stats_start = 0;
+
+uint32_t stats_now(void) {                  // Timer0 counts, interrupts disabled
+    uint8_t count = TCNT0;
+    uint32_t tick = stats_tick;
+    if ((TIFR0 & (1 << OCF0A)) && count < TOP_TIMER0)
+        tick++;                             // Compare match pending : not counted yet
+    return (tick * (TOP_TIMER0 + 1) + count);
+}
+
+void stats_tx(const char c) {
+    while (!(UCSR0A & (1 << UDRE0)))
+        ;
+    UDR0 = c;
+}
+
+void stats_init(void) {
+    UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
+    UBRR0L = (unsigned char)MYUBRR;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
+    UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // 8N1
+    UCSR0B = (1 << TXEN0);
+}
+
+void stats_report(void) {
+    uint32_t total = stats_now() - stats_start;     // Interrupts disabled
+    if (total < STATS_TICKS * (TOP_TIMER0 + 1))
+        return ;
+    uint8_t pct = sleep_counts * 100 / total;
+    stats_start += total;
+    sleep_counts = 0;
+    sei();
+    const char *str = "asleep ";
+    while (*str)
+        stats_tx(*str++);
+    if (pct >= 100)
+        stats_tx('1');
+    if (pct >= 10)
+        stats_tx('0' + pct / 10 % 10);
+    stats_tx('0' + pct % 10);
+    stats_tx('%');
+    stats_tx('\r');
+    stats_tx('\n');
+}
+#endif
+
+void idle(void) {                           // Returns after the next interrupt
+    cli();
+#if SLEEP_STATS
+    uint32_t start = stats_now();
+#endif
+    SMCR = (1 << SE);                       // SM2:0 = 000 : Idle mode
+    sei();                                  // sei always executes the next instruction first :
+    __asm__ __volatile__ ("sleep");         // no interrupt can slip in before the sleep
+    SMCR = 0;
+#if SLEEP_STATS
+    cli();
+    sleep_counts += stats_now() - start;
+    stats_report();
+    sei();
+#endif
+}
+
 // ************************************************************** INTERRUPTS */
 ISR(TIMER0_COMPA_vect) {                    // Interrupt for Timer0 : update duty cycle 1%
+#if SLEEP_STATS
+    stats_tick++;
+#endif
     static int8_t direction = 1;            // Increasing or decreasing duty cycle
     static uint8_t duty_cycle = 0;
     
@@ -35,11 +140,15 @@ ISR(TIMER0_COMPA_vect) {                    // Interrupt for Timer0 : update dut
 
 int main()
 {
+    power_init();
     setup_timer1();
     setup_timer0();
+#if SLEEP_STATS
+    stats_init();
+#endif
     sei();
     while (1)
-        ;
+        idle();
     return (0);
 }
 
@@ -2,11 +2,113 @@
 #include <util/delay.h>
 #include <avr/interrupt.h>
 
-#define DEBOUNCE_DELAY 80
+#define DEBOUNCE_MS 16                      // Former Timer0 overflow : 1024 * 256 / 16MHz
 #define MASK (PORTB & ~(0x07 | (1 << PB4)))
 
 volatile uint8_t value = 0;
 
+// ************************************************************** TIMER WHEEL */
+// Software timeouts on a single 1ms Timer1 tick : Timer0 & Timer2 stay free for PWM.
+// Hashed wheel of WHEEL_SLOTS lists : a timeout of `ms` goes in slot (now + ms) % WHEEL_SLOTS
+// with `rounds` = full turns to wait. Start / stop are O(1) list operations, a tick only
+// walks the current slot. swtimer_t is owned by the caller : no limit on the count.
+// Callbacks run from TIMER1_COMPA_vect and may start / stop any timer, themselves included.
+// The tick is stopped while no timer is armed.
+#define TOP_TIMER1  (F_CPU / 64UL / 1000 - 1)   // 1ms tick = 249
+#define WHEEL_SHIFT 4
+#define WHEEL_SLOTS (1 << WHEEL_SHIFT)
+#define WHEEL_MASK  (WHEEL_SLOTS - 1)
+#define WHEEL_IDLE  0xFF                    // swtimer_t.slot : not armed
+#define WHEEL_DUE   0xFE                    // swtimer_t.slot : expired this tick, not fired yet
+
+typedef struct swtimer_s {
+    struct swtimer_s *next;
+    struct swtimer_s *prev;
+    void (*fn)(void);
+    uint16_t rounds;                        // Full wheel turns left
+    uint8_t slot;                           // Wheel slot, WHEEL_IDLE or WHEEL_DUE
+} swtimer_t;
+
+swtimer_t *wheel[WHEEL_SLOTS];
+uint8_t wheel_pos = 0;                      // Slot of the last tick
+uint16_t wheel_armed = 0;
+
+void wheel_unlink(swtimer_t *t, uint8_t slot) {
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        wheel[slot] = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    t->slot = WHEEL_IDLE;
+    if (--wheel_armed == 0)
+        TCCR1B &= ~((1 << CS11) | (1 << CS10)); // Nothing left : stop the tick
+}
+
+void swtimer_init(swtimer_t *t) {
+    t->slot = WHEEL_IDLE;
+}
+
+void swtimer_stop(swtimer_t *t) {
+    uint8_t sreg = SREG;
+    cli();
+    if (t->slot == WHEEL_DUE)
+        wheel_unlink(t, wheel_pos);
+    else if (t->slot != WHEEL_IDLE)
+        wheel_unlink(t, t->slot);
+    SREG = sreg;
+}
+
+void swtimer_start(swtimer_t *t, uint16_t ms, void (*fn)(void)) {  // Fires once after ms
+    uint8_t sreg = SREG;
+    cli();
+    swtimer_stop(t);                        // Restart if already armed
+    if (ms == 0)
+        ms = 1;
+    uint8_t slot = (wheel_pos + ms) & WHEEL_MASK;
+    t->fn = fn;
+    t->rounds = (ms - 1) >> WHEEL_SHIFT;
+    t->slot = slot;
+    t->prev = 0;
+    t->next = wheel[slot];
+    if (t->next)
+        t->next->prev = t;
+    wheel[slot] = t;
+    if (wheel_armed++ == 0) {
+        TCNT1 = 0;                          // Full first tick
+        TCCR1B |= (1 << CS11) | (1 << CS10);    // Prescaler 64 : start the tick
+    }
+    SREG = sreg;
+}
+
+void wheel_init(void) {
+    TCCR1B = (1 << WGM12);                  // CTC Mode, TOP = OCR1A, stopped until a timer starts
+    OCR1A = TOP_TIMER1;
+    TIMSK1 |= (1 << OCIE1A);                // Enable Timer1 Compare Match A Interrupt
+}
+
+ISR(TIMER1_COMPA_vect) {
+    wheel_pos = (wheel_pos + 1) & WHEEL_MASK;
+    for (swtimer_t *t = wheel[wheel_pos]; t; t = t->next) {
+        if (t->rounds)
+            t->rounds--;
+        else
+            t->slot = WHEEL_DUE;            // Marked first : callbacks may edit the list
+    }
+    while (1) {
+        swtimer_t *t = wheel[wheel_pos];
+        while (t && t->slot != WHEEL_DUE)
+            t = t->next;
+        if (!t)
+            break;
+        wheel_unlink(t, wheel_pos);
+        t->fn();
+    }
+}
+
+swtimer_t debounce_sw1;
+swtimer_t debounce_sw2;
+
 // ******************************************************************* SETUP */
 void setup_io() {
     // Set PB0, PB1, PB2 & PB4 as outputs
@@ -36,17 +138,7 @@ static void display_value(volatile uint8_t value)
 }
 
 // ********************************************************************* SW1 */
-ISR(INT0_vect) {                            // Interrupt for INT0 - button press
-    EIMSK &= ~(1 << INT0);                  // Disable INT0 to prevent multiple triggers
-    TCCR0B |= (1 << CS02) | (1 << CS00);    // Set Timer0 prescaler to 1024 for debounce
-    TCNT0 = 0;                              // Reset Timer0
-    TIMSK0 |= (1 << TOIE0);                 // Enable Timer0 overflow interrupt
-}
-
-ISR(TIMER0_OVF_vect) {
-    TIMSK0 &= ~(1 << TOIE0);                // Disable Timer0 interrupt
-    TCCR0B &= ~((1 << CS02) | (1 << CS00)); // Stop Timer0
-
+void sw1_debounced(void) {
     if (!((PIND & (1 << PD2))) && value < 15) {
         value++;                            // Increment value
         display_value(value);               // Update display
@@ -55,18 +147,13 @@ ISR(TIMER0_OVF_vect) {
     EIMSK |= (1 << INT0);                   // Re-enable INT0
 }
 
-// ********************************************************************* SW2 */
-ISR(PCINT2_vect) {                          // Interrupt for SW2
-    PCMSK2 &= ~(1 << PCINT20);              // Disable PCINT20
-    TCCR2B |= (1 << CS22) | (1 << CS20);    // Set Timer2 prescaler to 1024 for debounce
-    TCNT2 = 0;                              // Reset Timer2
-    TIMSK2 |= (1 << TOIE2);                 // Enable Timer2 overflow interrupt
+ISR(INT0_vect) {                            // Interrupt for INT0 - button press
+    EIMSK &= ~(1 << INT0);                  // Disable INT0 to prevent multiple triggers
+    swtimer_start(&debounce_sw1, DEBOUNCE_MS, sw1_debounced);
 }
 
-ISR(TIMER2_OVF_vect) {
-    TIMSK2 &= ~(1 << TOIE2);                // Disable Timer2 interrupt
-    TCCR2B &= ~((1 << CS22) | (1 << CS20)); // Stop Timer2
-
+// ********************************************************************* SW2 */
+void sw2_debounced(void) {
     if (!((PIND & (1 << PD4))) && value > 0) {
         value--;                            // Decrement value
         display_value(value);               // Update display
@@ -75,9 +162,17 @@ ISR(TIMER2_OVF_vect) {
     PCMSK2 |= (1 << PCINT20);               // Enable PCINT20
 }
 
+ISR(PCINT2_vect) {                          // Interrupt for SW2
+    PCMSK2 &= ~(1 << PCINT20);              // Disable PCINT20
+    swtimer_start(&debounce_sw2, DEBOUNCE_MS, sw2_debounced);
+}
+
 int main()
 {
     setup_io();
+    wheel_init();
+    swtimer_init(&debounce_sw1);
+    swtimer_init(&debounce_sw2);
     init_interrupts();
     while (1)
         ;
@@ -3,28 +3,94 @@
 #include <avr/interrupt.h>
 
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))     // Round to nearest integer
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
+
+// Streaming mode ('S' to start, 'T' back to text) : 10-bit samples at STREAM_HZ
+// '0' to '3' in text mode : 115200, 250000, 500000, 1000000 baud (stream_decode.py [baud])
+// Frame = SYNC | seq | dropped (LSB, MSB) | STREAM_SAMPLES / 4 groups of 5 bytes
+// Group = bits 9..2 of s0, s1, s2, s3 | bits 1..0 of s0 (b1..0), s1, s2, s3 (b7..6)
+// 84 bytes per 64 samples at 8kHz = 10500 bytes/s, 115200 baud (U2X0, UBRR 16) carries 11764
+#define STREAM_HZ       8000
+#define TOP_TIMER1      (F_CPU / 8UL / STREAM_HZ - 1)   // ADC trigger period = 249
+#define STREAM_SYNC     0xA5
+#define STREAM_SAMPLES  64                  // Per frame, multiple of 4
+#define STREAM_HEADER   4
+#define STREAM_FRAME    (STREAM_HEADER + STREAM_SAMPLES / 4 * 5)
+
+uint8_t frames[2][STREAM_FRAME];            // One filled by ADC_vect, one sent by USART_UDRE_vect
+volatile uint8_t streaming = 0;
+volatile uint8_t tx_busy = 0;
+volatile uint16_t dropped = 0;              // Samples lost because the UART was still busy
+uint8_t fill = 0;                           // Frame being filled, ISR only
+uint8_t fill_pos = STREAM_HEADER;           // First byte of the current group, ISR only
+uint8_t group_n = 0;                        // Sample index in the current group, ISR only
+uint8_t lows = 0;                           // Low bits of the current group, ISR only
+uint8_t seq = 0;                            // Frame sequence number, ISR only
+const uint8_t *tx_ptr;
+uint8_t tx_left = 0;
 
 // ************************************************************** UART SETUP */
 void uart_init() {
     UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)MYUBRR;
-    UCSR0B = (1 << TXEN0);                  // Enable transmitter
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0);   // Enable receiver & transmitter
     UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // Set frame format to 8N1 (8-bit frame, 1 stop bit, no parity)
 }
 
 void uart_tx(const char c) {
     while (!(UCSR0A & (1 << UDRE0)))        // Wait for empty transmit buffer (if 0, buffer = full)
         ;
+    UCSR0A |= (1 << TXC0);                  // Clear Transmit Complete, set again once c is out
     UDR0 = c;                               // Put data into buffer, sends data
 }
 
+// Runtime rates : 250k, 500k & 1M are exact at 16MHz in normal mode (UBRR 3, 1, 0)
+const uint32_t bauds[] = {UART_BAUDRATE, 250000, 500000, 1000000};
+
+void uart_set_baud(uint32_t baud) {         // TXC0 : the last character has left at the old rate
+    while (!(UCSR0A & (1 << TXC0)))
+        ;
+    if (baud == UART_BAUDRATE) {
+        UBRR0 = MYUBRR;
+        UCSR0A = (UART_U2X << U2X0);
+    } else {
+        UBRR0 = F_CPU / (16UL * baud) - 1;
+        UCSR0A = 0;
+    }
+}
+
+ISR(USART_UDRE_vect) {                      // Data register empty : send the next frame byte
+    UCSR0A |= (1 << TXC0);
+    UDR0 = *tx_ptr++;
+    if (--tx_left == 0) {
+        UCSR0B &= ~(1 << UDRIE0);           // Frame sent, wait for the next one
+        tx_busy = 0;
+    }
+}
+
 // *************************************************************** ADC SETUP */
 void adc_init(void) {
     ADMUX = (1 << REFS0) | (1 << ADLAR);    // Set AVCC voltage reference, ADC Left Adjust Result
     ADCSRA = (1 << ADEN) | (1 << ADPS0)     // Enable ADC
         | (1 << ADPS1) | (1 << ADPS2);      // prescaler 128 (125kHz ADC clock frequency)
+    ADCSRB = (1 << ADTS2) | (1 << ADTS0);   // Auto trigger source : Timer/Counter1 Compare Match B
 }
 
 uint8_t adc_read(void) {
@@ -35,25 +101,100 @@ uint8_t adc_read(void) {
     return (ADCH);                          // Read 8-bit ADC result
 }
 
+// ************************************************************** STREAMING */
+void timer1_init(void) {
+    TCCR1B = (1 << WGM12);                  // CTC Mode, TOP = OCR1A, stopped until streaming
+    OCR1A = TOP_TIMER1;
+    OCR1B = TOP_TIMER1;                     // Compare B on TOP = ADC trigger
+}
+
+ISR(ADC_vect) {
+    uint8_t low = ADCL;                     // ADCL first : locks ADCH until it is read
+    uint8_t *frame = frames[fill];
+
+    frame[fill_pos + group_n] = ADCH;       // Bits 9..2 (left adjusted)
+    lows = (lows >> 2) | (low & 0xC0);      // Bits 1..0, s0 ends up in b1..0 after 4 samples
+    if (++group_n == 4) {
+        frame[fill_pos + 4] = lows;
+        group_n = 0;
+        fill_pos += 5;
+        if (fill_pos == STREAM_FRAME) {     // Frame complete
+            frame[0] = STREAM_SYNC;
+            frame[1] = seq++;               // Incremented on drops too : the host sees the gap
+            frame[2] = dropped & 0xFF;
+            frame[3] = dropped >> 8;
+            if (!tx_busy) {                 // Swap : send this one, fill the other
+                tx_ptr = frame;
+                tx_left = STREAM_FRAME;
+                tx_busy = 1;
+                fill ^= 1;
+                UCSR0B |= (1 << UDRIE0);
+            } else
+                dropped += STREAM_SAMPLES;  // UART behind : overwrite this frame
+            fill_pos = STREAM_HEADER;
+        }
+    }
+    TIFR1 = (1 << OCF1B);                   // Clear the trigger flag so the next compare re-triggers
+}
+
+void stream_start(void) {
+    fill = 0;
+    fill_pos = STREAM_HEADER;
+    group_n = 0;
+    seq = 0;
+    dropped = 0;
+    ADMUX = (ADMUX & 0xF0) | 0x00;          // Select ADC0
+    TCNT1 = 0;
+    TIFR1 = (1 << OCF1B);
+    ADCSRA |= (1 << ADIF);                  // Drop the flag of the last text mode conversion
+    ADCSRA |= (1 << ADATE) | (1 << ADIE);   // Auto trigger + conversion complete interrupt
+    TCCR1B |= (1 << CS11);                  // Start Timer1, prescaler 8
+    streaming = 1;
+}
+
+void stream_stop(void) {
+    TCCR1B &= ~(1 << CS11);                 // Stop the triggers
+    ADCSRA &= ~((1 << ADATE) | (1 << ADIE));
+    while (tx_busy)                         // Let the last frame go out
+        ;
+    streaming = 0;
+}
+
 // ********************************************************* CONVERT & PRINT */
 void convert_and_print(uint8_t value) {
     const char hex_chars[] = "0123456789abcdef";
 
     // Extract upper and lower 4 bits + convert to hex
-    uart_tx(hex_chars[(value >> 4) & 0x0F]);  
+    uart_tx(hex_chars[(value >> 4) & 0x0F]);
     uart_tx(hex_chars[value & 0x0F]);
     uart_tx('\n');
     uart_tx('\r');
 }
 
+void handle_input(void) {
+    if (!(UCSR0A & (1 << RXC0)))            // Nothing received
+        return ;
+    char c = UDR0;
+    if (c == 'S' && !streaming)
+        stream_start();
+    else if (c == 'T' && streaming)
+        stream_stop();
+    else if (c >= '0' && c <= '3' && !streaming)
+        uart_set_baud(bauds[c - '0']);
+}
+
 int main() {
     uart_init();
     adc_init();
+    timer1_init();
     sei();
     while (1) {
-        uint8_t adc_value = adc_read();     // Read ADC value
-        convert_and_print(adc_value);       // Convert and send ADC value
-        _delay_ms(20);
+        handle_input();
+        if (!streaming) {
+            uint8_t adc_value = adc_read(); // Read ADC value
+            convert_and_print(adc_value);   // Convert and send ADC value
+            _delay_ms(20);
+        }
     }
     return (0);
 }
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+# Host decoder for the module_05/ex00 streaming mode.
+#
+#   python3 stream_decode.py /dev/ttyUSB0 [seconds] [baud]   -> samples on stdout, stats on stderr
+#   python3 stream_decode.py capture.bin              -> decode a raw capture file
+#
+# Frame (cf. main.c) : SYNC | seq | dropped (LSB, MSB) | 16 groups of 5 bytes
+# Group : bits 9..2 of s0..s3, then bits 1..0 of s0 (b1..0), s1, s2, s3 (b7..6)
+
+import os
+import sys
+import time
+
+SYNC = 0xA5
+SAMPLES = 64
+HEADER = 4
+FRAME = HEADER + SAMPLES // 4 * 5
+BAUD = 115200
+BAUDS = {115200: b"0", 250000: b"1", 500000: b"2", 1000000: b"3"}  # Device baud selection
+
+
+def unpack(payload):
+    samples = []
+    for g in range(0, len(payload), 5):
+        lows = payload[g + 4]
+        for n in range(4):
+            samples.append((payload[g + n] << 2) | ((lows >> (2 * n)) & 0x03))
+    return samples
+
+
+def frames(stream):
+    """Yield (seq, dropped, samples), resyncing on SYNC followed by a valid next SYNC.
+    The final frame has no SYNC after it and is taken as is."""
+    buf = bytearray()
+    for chunk in stream:
+        buf += chunk
+        while len(buf) >= FRAME + 1:
+            if buf[0] != SYNC or buf[FRAME] != SYNC:
+                del buf[0]                          # SYNC can also appear in the payload
+                continue
+            yield buf[1], buf[2] | (buf[3] << 8), unpack(buf[HEADER:FRAME])
+            del buf[:FRAME]
+    if len(buf) >= FRAME and buf[0] == SYNC:        # Last frame : no SYNC after it
+        yield buf[1], buf[2] | (buf[3] << 8), unpack(buf[HEADER:FRAME])
+
+
+def serial_chunks(port, seconds, baud):
+    import serial                                   # pyserial
+    with serial.Serial(port, BAUD, timeout=0.1) as ser:
+        if baud != BAUD:                            # Switch the device, then follow it
+            ser.write(BAUDS[baud])
+            ser.flush()
+            time.sleep(0.05)
+            ser.baudrate = baud
+            ser.reset_input_buffer()
+        ser.write(b"S")
+        end = time.time() + seconds
+        try:
+            while time.time() < end:
+                yield ser.read(4096)
+        finally:
+            ser.write(b"T")
+            if baud != BAUD:
+                ser.write(BAUDS[BAUD])              # Back to the default rate
+
+
+def file_chunks(path):
+    with open(path, "rb") as f:
+        while True:
+            chunk = f.read(4096)
+            if not chunk:
+                return
+            yield chunk
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: stream_decode.py PORT|FILE [seconds] [baud]\n")
+        return 1
+    src = sys.argv[1]
+    if os.path.isfile(src):
+        chunks = file_chunks(src)
+    else:
+        baud = int(sys.argv[3]) if len(sys.argv) > 3 else BAUD
+        if baud not in BAUDS:
+            sys.stderr.write("baud : %s\n" % " | ".join(str(b) for b in sorted(BAUDS)))
+            return 1
+        chunks = serial_chunks(src, float(sys.argv[2]) if len(sys.argv) > 2 else 5.0, baud)
+
+    start = time.time()
+    nb_frames = nb_samples = lost_frames = 0
+    last_seq = None
+    dropped = 0
+    for seq, dropped, samples in frames(chunks):
+        if last_seq is not None and seq != (last_seq + 1) & 0xFF:
+            lost_frames += (seq - last_seq - 1) & 0xFF
+        last_seq = seq
+        nb_frames += 1
+        nb_samples += len(samples)
+        sys.stdout.write("\n".join(str(s) for s in samples) + "\n")
+    elapsed = time.time() - start
+    sys.stderr.write("%d frames, %d samples, %.0f samples/s, %d frames skipped, "
+                     "%d samples dropped on the device\n"
+                     % (nb_frames, nb_samples, nb_samples / elapsed if elapsed else 0,
+                        lost_frames, dropped))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -3,8 +3,30 @@
 #include <avr/interrupt.h>
 
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))     // Round to nearest integer
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
+
+#define ADC_SAMPLE_HZ 1500                  // Conversions per second, shared by all channels
+#define TOP_TIMER1 (F_CPU / 64UL / ADC_SAMPLE_HZ - 1)   // ADC trigger period = 165
+#define ADC_BUF_SIZE 4                      // Samples kept per channel (power of 2)
+#define POT 0                               // Index in adc_channels
+#define LDR 1
+#define NTC 2
 
 char pot[3];
 char ldr[3];
@@ -14,6 +36,7 @@ char ntc[3];
 void uart_init() {
     UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)MYUBRR;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
     UCSR0B = (1 << TXEN0);                  // Enable transmitter
     UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // Set frame format to 8N1 (8-bit frame, 1 stop bit, no parity)
 }
@@ -31,35 +54,47 @@ void uart_print_str(const char *str) {
     }
 }
 
-// *************************************************************** ADC SETUP */
+// *********************************************************** ADC SEQUENCER */
+// Timer1 Compare Match B auto-triggers each conversion, ADC_vect stores the result
+// & selects the next channel of adc_channels : no conversion is ever waited on
+const uint8_t adc_channels[] = {0x00, 0x01, 0x02};   // ADC0 = POT, ADC1 = LDR, ADC2 = NTC
+#define ADC_NB_CHANNELS sizeof(adc_channels)
+
+volatile uint8_t adc_buf[ADC_NB_CHANNELS][ADC_BUF_SIZE];    // Last samples of each channel
+volatile uint8_t adc_head[ADC_NB_CHANNELS]; // Slot of the most recent sample
+volatile uint8_t adc_index = 0;             // Channel being converted
+
 void adc_init(void) {
-    ADMUX = (1 << REFS0) | (1 << ADLAR);    // Set AVCC voltage reference, ADC Left Adjust Result
-    ADCSRA = (1 << ADEN) | (1 << ADPS0)     // Enable ADC
-        | (1 << ADPS1) | (1 << ADPS2);      // prescaler 128 (125kHz ADC clock frequency)
+    ADMUX = (1 << REFS0) | (1 << ADLAR)     // Set AVCC voltage reference, ADC Left Adjust Result
+        | adc_channels[0];                  // Select first channel
+    ADCSRB = (1 << ADTS2) | (1 << ADTS0);   // Auto trigger source : Timer/Counter1 Compare Match B
+    ADCSRA = (1 << ADEN) | (1 << ADATE)     // Enable ADC & auto trigger
+        | (1 << ADIE)                       // Enable ADC conversion complete interrupt
+        | (1 << ADPS0) | (1 << ADPS1) | (1 << ADPS2);   // Prescaler 128 (125kHz ADC clock frequency)
 }
 
-uint8_t adc_read_pot(void) {
-    ADMUX = (ADMUX & 0xF0) | 0x00;          // Select ADC0
-    ADCSRA |= (1 << ADSC);                  // Start conversion
-    while (ADCSRA & (1 << ADSC))            // Wait for conversion to complete
-        ;
-    return (ADCH);                          // Read 8-bit ADC result
+void timer1_init(void) {
+    TCCR1B = (1 << WGM12)                   // CTC Mode, TOP = OCR1A
+        | (1 << CS11) | (1 << CS10);        // Prescaler 64
+    OCR1A = TOP_TIMER1;
+    OCR1B = TOP_TIMER1;                     // Compare B on TOP = ADC trigger
 }
 
-uint8_t adc_read_ldr(void) {
-    ADMUX = (ADMUX & 0xF0) | 0x01;          // Select ADC1
-    ADCSRA |= (1 << ADSC);                  // Start conversion
-    while (ADCSRA & (1 << ADSC))            // Wait for conversion to complete
-        ;
-    return (ADCH);                          // Read 8-bit ADC result
+ISR(ADC_vect) {
+    uint8_t ch = adc_index;
+    uint8_t head = (adc_head[ch] + 1) & (ADC_BUF_SIZE - 1);
+    adc_buf[ch][head] = ADCH;               // Read 8-bit ADC result
+    adc_head[ch] = head;
+
+    if (++ch == ADC_NB_CHANNELS)            // Round-robin on the channel list
+        ch = 0;
+    adc_index = ch;
+    ADMUX = (ADMUX & 0xF0) | adc_channels[ch];  // Latched at the start of the next conversion
+    TIFR1 = (1 << OCF1B);                   // Clear the trigger flag so the next compare re-triggers
 }
 
-uint8_t adc_read_ntc(void) {
-    ADMUX = (ADMUX & 0xF0) | 0x02;          // Select ADC2
-    ADCSRA |= (1 << ADSC);                  // Start conversion
-    while (ADCSRA & (1 << ADSC))            // Wait for conversion to complete
-        ;
-    return (ADCH);                          // Read 8-bit ADC result
+uint8_t adc_get(uint8_t ch) {               // Most recent sample of a channel
+    return (adc_buf[ch][adc_head[ch]]);
 }
 
 // ********************************************************* CONVERT & PRINT */
@@ -83,6 +118,8 @@ void print_result()
 }
 
 // ******************************************************* TIMER & INTERRUPT */
+volatile uint8_t print_ready = 0;
+
 void timer0_init(void) {
     TCCR0B = (1 << CS01) | (1 << CS00);     // Prescaler 64
     TIMSK0 |= (1 << TOIE0);                 // Enable Timer0 overflow interrupt
@@ -93,13 +130,7 @@ ISR(TIMER0_OVF_vect) {                      // Timer 0 Compare Interrupt
     ovf_count++;
     if (ovf_count >= 20) {
         ovf_count = 0;
-        uint8_t adc_pot_value = adc_read_pot();
-        convert(adc_pot_value, pot);
-        uint8_t adc_ldr_value = adc_read_ldr();
-        convert(adc_ldr_value, ldr);
-        uint8_t adc_ntc_value = adc_read_ntc();
-        convert(adc_ntc_value, ntc);
-        print_result();
+        print_ready = 1;
     }
 }
 
@@ -107,8 +138,16 @@ int main() {
     uart_init();
     adc_init();
     timer0_init();
+    timer1_init();
     sei();
-    while (1)
-        ;
+    while (1) {
+        if (print_ready) {                  // Values are already sampled, just format them
+            print_ready = 0;
+            convert(adc_get(POT), pot);
+            convert(adc_get(LDR), ldr);
+            convert(adc_get(NTC), ntc);
+            print_result();
+        }
+    }
     return (0);
 }
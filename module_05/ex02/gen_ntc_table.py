@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# Generates ntc_table[] for main.c : NTC temperature (centi-degrees C) at
+# NTC_SEGMENTS + 1 evenly spaced ADC counts, linearly interpolated at runtime.
+# Also checks the interpolation error against the exact Beta equation.
+#
+#   python3 gen_ntc_table.py            -> C table on stdout, error report on stderr
+#
+# Divider (devkit schema) : +5V -- R20 (10K) -- ADC_NTC -- NTC -- GND
+
+import math
+import sys
+
+ADC_BITS = 12               # Oversampled NTC channel (adc_extra_bits = 2)
+NTC_SEGMENTS = 64           # Table entries - 1, must be a power of 2
+R_FIXED = 10000.0           # R20
+R25 = 10000.0               # NTC resistance at 25 C
+BETA = 3950.0               # NTC Beta (25/85)
+T_MIN, T_MAX = -40.0, 125.0 # Clamp outside the NTC operating range
+
+ADC_MAX = 1 << ADC_BITS
+STEP = ADC_MAX // NTC_SEGMENTS
+
+
+def temperature(count):
+    """Exact Beta-equation temperature (C) for an ADC count, clamped."""
+    ratio = (count + 0.5) / ADC_MAX              # Mid-code of the ADC step
+    if ratio >= 1.0:
+        return T_MIN
+    r_ntc = R_FIXED * ratio / (1.0 - ratio)
+    inv_t = 1.0 / 298.15 + math.log(r_ntc / R25) / BETA
+    return min(T_MAX, max(T_MIN, 1.0 / inv_t - 273.15))
+
+
+def table():
+    return [round(temperature(min(i * STEP, ADC_MAX - 1)) * 100)
+            for i in range(NTC_SEGMENTS + 1)]
+
+
+def interpolate(tab, count):
+    """Same integer math as ntc_to_centi() in main.c."""
+    idx = count // STEP
+    frac = count % STEP
+    if idx >= NTC_SEGMENTS:
+        return tab[NTC_SEGMENTS]
+    a, b = tab[idx], tab[idx + 1]
+    return a + (((b - a) * frac) >> (STEP.bit_length() - 1))
+
+
+def main():
+    tab = table()
+    shift = STEP.bit_length() - 1
+    print("// Generated by gen_ntc_table.py : R %d, R25 %d, Beta %d, %d-bit ADC"
+          % (R_FIXED, R25, BETA, ADC_BITS))
+    print("#define NTC_SHIFT %d                       // ADC counts per segment = 2^NTC_SHIFT"
+          % shift)
+    print("#define NTC_SEGMENTS %d" % NTC_SEGMENTS)
+    print("const int16_t ntc_table[NTC_SEGMENTS + 1] PROGMEM = {")
+    for i in range(0, len(tab), 8):
+        row = ", ".join("%6d" % v for v in tab[i:i + 8])
+        print("    " + row + ("," if i + 8 < len(tab) else ""))
+    print("};")
+
+    # Accuracy check over the range where the NTC is usable
+    worst, worst_count = 0.0, 0
+    for count in range(ADC_MAX):
+        exact = temperature(count)
+        if exact <= T_MIN or exact >= T_MAX:
+            continue
+        err = abs(interpolate(tab, count) / 100.0 - exact)
+        if -20.0 <= exact <= 100.0 and err > worst:
+            worst, worst_count = err, count
+    sys.stderr.write("max interpolation error -20..100 C : %.3f C at count %d\n"
+                     % (worst, worst_count))
+    return 0 if worst < 0.5 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,19 +1,43 @@
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))     // Round to nearest integer
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
+
+#define ADC_SAMPLE_HZ 6000                  // Conversions per second, shared by all channels
+#define TOP_TIMER1 (F_CPU / 64UL / ADC_SAMPLE_HZ - 1)   // ADC trigger period = 40
+#define ADC_BUF_SIZE 4                      // Samples kept per channel (power of 2)
+#define POT 0                               // Index in adc_channels
+#define LDR 1
+#define NTC 2
 
 char pot[5];
 char ldr[5];
-char ntc[5];
+char ntc[8];
 
 // ************************************************************** UART SETUP */
 void uart_init() {
     UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)MYUBRR;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
     UCSR0B = (1 << TXEN0);                  // Enable transmitter
     UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // Set frame format to 8N1 (8-bit frame, 1 stop bit, no parity)
 }
@@ -31,35 +55,67 @@ void uart_print_str(const char *str) {
     }
 }
 
-// *************************************************************** ADC SETUP */
+// *********************************************************** ADC SEQUENCER */
+// Timer1 Compare Match B auto-triggers each conversion, ADC_vect stores the result
+// & selects the next channel of adc_channels : no conversion is ever waited on
+const uint8_t adc_channels[] = {0x00, 0x01, 0x02};   // ADC0 = POT, ADC1 = LDR, ADC2 = NTC
+#define ADC_NB_CHANNELS sizeof(adc_channels)
+
+// Oversampling & decimation : sum 4^n samples then shift right by n = 10 + n bits result
+// Real bits only with ~0.5 LSB rms of noise or more on the input : on a quiet input the
+// extra bits stay 0 & n only costs rate (bench_oversampling.py : ENOB vs n, noise & rate)
+// n <= 3 so that the 64 samples sum still fits in 16 bits
+// Channel output rate = ADC_SAMPLE_HZ / ADC_NB_CHANNELS / 4^n (NTC : 125Hz at 12 bits)
+const uint8_t adc_extra_bits[] = {0, 0, 2}; // POT 10 bits, LDR 10 bits, NTC 12 bits
+
+volatile uint16_t adc_buf[ADC_NB_CHANNELS][ADC_BUF_SIZE];   // Last samples of each channel
+volatile uint8_t adc_head[ADC_NB_CHANNELS];  // Slot of the most recent sample
+volatile uint8_t adc_index = 0;             // Channel being converted
+uint16_t adc_acc[ADC_NB_CHANNELS];          // Oversampling running sum, ISR only
+uint8_t adc_acc_count[ADC_NB_CHANNELS];     // Samples in adc_acc, ISR only
+
 void adc_init(void) {
-    ADMUX = (1 << REFS0);                   // Set AVCC voltage reference
-    ADCSRA = (1 << ADEN) | (1 << ADPS0)     // Enable ADC
-        | (1 << ADPS1) | (1 << ADPS2);      // Prescaler 128 (125kHz ADC clock frequency)
+    ADMUX = (1 << REFS0) | adc_channels[0]; // Set AVCC voltage reference, select first channel
+    ADCSRB = (1 << ADTS2) | (1 << ADTS0);   // Auto trigger source : Timer/Counter1 Compare Match B
+    ADCSRA = (1 << ADEN) | (1 << ADATE)     // Enable ADC & auto trigger
+        | (1 << ADIE)                       // Enable ADC conversion complete interrupt
+        | (1 << ADPS0) | (1 << ADPS1) | (1 << ADPS2);   // Prescaler 128 (125kHz ADC clock frequency)
 }
 
-uint16_t adc_read_pot(void) {
-    ADMUX = (ADMUX & 0xF0) | 0x00;          // Select ADC0
-    ADCSRA |= (1 << ADSC);                  // Start conversion
-    while (ADCSRA & (1 << ADSC))            // Wait for conversion to complete
-        ;
-        return (ADCL | (ADCH << 8));        // Read 10-bit ADC result (ADCL + ADCH shifted left 8 bits)
+void timer1_init(void) {
+    TCCR1B = (1 << WGM12)                   // CTC Mode, TOP = OCR1A
+        | (1 << CS11) | (1 << CS10);        // Prescaler 64
+    OCR1A = TOP_TIMER1;
+    OCR1B = TOP_TIMER1;                     // Compare B on TOP = ADC trigger
 }
 
-uint16_t adc_read_ldr(void) {
-    ADMUX = (ADMUX & 0xF0) | 0x01;          // Select ADC1
-    ADCSRA |= (1 << ADSC);                  // Start conversion
-    while (ADCSRA & (1 << ADSC))            // Wait for conversion to complete
-        ;
-    return (ADCL | (ADCH << 8));            // Read 10-bit ADC result (ADCL + ADCH shifted left 8 bits)
+ISR(ADC_vect) {
+    uint8_t ch = adc_index;
+    uint8_t n = adc_extra_bits[ch];
+    uint16_t acc = adc_acc[ch] + ADC;       // Read 10-bit ADC result (ADCL then ADCH)
+
+    if (++adc_acc_count[ch] == (uint8_t)(1 << (n << 1))) {  // 4^n samples collected : decimate
+        uint8_t head = (adc_head[ch] + 1) & (ADC_BUF_SIZE - 1);
+        adc_buf[ch][head] = acc >> n;
+        adc_head[ch] = head;
+        adc_acc_count[ch] = 0;
+        acc = 0;
+    }
+    adc_acc[ch] = acc;
+
+    if (++ch == ADC_NB_CHANNELS)            // Round-robin on the channel list
+        ch = 0;
+    adc_index = ch;
+    ADMUX = (ADMUX & 0xF0) | adc_channels[ch];  // Latched at the start of the next conversion
+    TIFR1 = (1 << OCF1B);                   // Clear the trigger flag so the next compare re-triggers
 }
 
-uint16_t adc_read_ntc(void) {
-    ADMUX = (ADMUX & 0xF0) | 0x02;          // Select ADC2
-    ADCSRA |= (1 << ADSC);                  // Start conversion
-    while (ADCSRA & (1 << ADSC))            // Wait for conversion to complete
-        ;
-        return (ADCL | (ADCH << 8));        // Read 10-bit ADC result (ADCL + ADCH shifted left 8 bits)
+uint16_t adc_get(uint8_t ch) {              // Most recent sample of a channel, 10 + n bits
+    uint16_t value;
+    cli();
+    value = adc_buf[ch][adc_head[ch]];
+    sei();
+    return (value);
 }
 
 // ********************************************************* CONVERT & PRINT */
@@ -82,6 +138,48 @@ void convert(uint16_t value, char *dest) {  // itoa conversion
     dest[i] = '\0';
 }
 
+// ***************************************************************** NTC LUT */
+// ADC counts -> centi-degrees C : table lookup + linear interpolation, no log()
+// Regenerate with gen_ntc_table.py when the divider, the NTC or adc_extra_bits change
+// Generated by gen_ntc_table.py : R 10000, R25 10000, Beta 3950, 12-bit ADC
+#define NTC_SHIFT 6                       // ADC counts per segment = 2^NTC_SHIFT
+#define NTC_SEGMENTS 64
+const int16_t ntc_table[NTC_SEGMENTS + 1] PROGMEM = {
+     12500,  12500,  12500,  11264,  10153,   9320,   8656,   8103,
+      7630,   7215,   6846,   6513,   6208,   5928,   5667,   5424,
+      5194,   4977,   4771,   4574,   4385,   4204,   4029,   3859,
+      3694,   3534,   3378,   3225,   3075,   2928,   2783,   2640,
+      2499,   2359,   2220,   2082,   1944,   1806,   1669,   1531,
+      1392,   1252,   1111,    969,    824,    677,    527,    373,
+       216,     53,   -115,   -290,   -473,   -665,   -868,  -1086,
+     -1320,  -1577,  -1861,  -2185,  -2563,  -3027,  -3643,  -4000,
+     -4000
+};
+
+int16_t ntc_to_centi(uint16_t value) {
+    uint8_t idx = value >> NTC_SHIFT;
+    uint8_t frac = value & ((1 << NTC_SHIFT) - 1);
+    if (idx >= NTC_SEGMENTS)
+        return (pgm_read_word(&ntc_table[NTC_SEGMENTS]));
+    int16_t a = pgm_read_word(&ntc_table[idx]);
+    int16_t b = pgm_read_word(&ntc_table[idx + 1]);
+    return (a + (((int32_t)(b - a) * frac) >> NTC_SHIFT));
+}
+
+void convert_centi(int16_t value, char *dest) {     // -1234 -> "-12.34"
+    if (value < 0) {
+        *dest++ = '-';
+        value = -value;
+    }
+    convert(value / 100, dest);
+    while (*dest)
+        dest++;
+    *dest++ = '.';
+    *dest++ = '0' + (value / 10) % 10;
+    *dest++ = '0' + value % 10;
+    *dest = '\0';
+}
+
 void print_result()
 {
     uart_print_str(pot);
@@ -93,6 +191,8 @@ void print_result()
 }
 
 // ******************************************************* TIMER & INTERRUPT */
+volatile uint8_t print_ready = 0;
+
 void timer0_init(void) {
     TCCR0B = (1 << CS01) | (1 << CS00);     // Prescaler 64
     TIMSK0 |= (1 << TOIE0);                 // Enable Timer0 overflow interrupt
@@ -103,10 +203,7 @@ ISR(TIMER0_OVF_vect) {                      // Timer 0 Compare Interrupt
     ovf_count++;
     if (ovf_count >= 20) {
         ovf_count = 0;
-        convert(adc_read_pot(), pot);
-        convert(adc_read_ldr(), ldr);
-        convert(adc_read_ntc(), ntc);
-        print_result();
+        print_ready = 1;
     }
 }
 
@@ -114,8 +211,16 @@ int main() {
     uart_init();
     adc_init();
     timer0_init();
+    timer1_init();
     sei();
-    while (1)
-        ;
+    while (1) {
+        if (print_ready) {                  // Values are already sampled, just format them
+            print_ready = 0;
+            convert(adc_get(POT), pot);
+            convert(adc_get(LDR), ldr);
+            convert_centi(ntc_to_centi(adc_get(NTC)), ntc);
+            print_result();
+        }
+    }
     return (0);
 }
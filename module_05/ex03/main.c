@@ -1,25 +1,76 @@
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))     // Round to nearest integer
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
 
-char temp_str[5];
+#define RED         "\e[1;31m"
+#define GREEN       "\e[1;32m"
+#define RESET       "\033[0m"
+#define BAD_INPUT   "Bad input - CAL1 <temp> | CAL2 <temp> | CALRESET"
+
+#define NB_SAMPLES  16                      // Conversions averaged per reading (power of 2)
+#define RX_QUIET    50                      // Readings without sleep after a received char (~1s)
+#define CALIB_ADDR  0x3F8                   // Reserved EEPROM record : last 8 bytes
+#define MAGIC_CALIB 0xCA                    // Record is valid
+#define DEFAULT_GAIN    2724                // 1.064 C/count = 10.64 tenths/count, x256
+#define DEFAULT_OFFSET  -3142               // 55 C - 1.064 * 347 = -314.2 C, in tenths
+#define CAL_MIN_SPAN    8                   // Min raw counts between the 2 points (~8 C)
+#define CAL_TEMP_MIN    -40                 // Accepted reference temperatures, C
+#define CAL_TEMP_MAX    125
+
+char temp_str[7];
+char buf[16];
+uint8_t i = 0;
+uint8_t uart_sent = 0;
+uint8_t rx_active = 0;                      // USART RX is halted in sleep : stay awake while typing
+
+int16_t gain = DEFAULT_GAIN;                // Tenths of C per ADC count, Q8.8
+int16_t offset = DEFAULT_OFFSET;            // Tenths of C
+uint16_t cal_raw = 0;                       // First calibration point
+int16_t cal_temp = 0;
+uint8_t cal_step = 0;                       // 1 once CAL1 has been captured
 
 // ************************************************************** UART SETUP */
 void uart_init() {
     UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)MYUBRR;
-    UCSR0B = (1 << TXEN0);                  // Enable transmitter
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0);   // Enable receiver & transmitter
     UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // Set frame format to 8N1 (8-bit frame, 1 stop bit, no parity)
 }
 
 void uart_tx(const char c) {
     while (!(UCSR0A & (1 << UDRE0)))        // Wait for empty transmit buffer (if 0, buffer = full)
         ;
+    UCSR0A |= (1 << TXC0);                  // Clear Transmit Complete, set again once c is out
     UDR0 = c;                               // Put data into buffer, sends data
+    uart_sent = 1;
+}
+
+void uart_flush(void) {                     // Wait for the shift register to be empty
+    if (uart_sent)                          // (the USART clock stops in sleep mode)
+        while (!(UCSR0A & (1 << TXC0)))
+            ;
 }
 
 void uart_print_str(const char *str) {
@@ -31,23 +82,118 @@ void uart_print_str(const char *str) {
 
 // *************************************************************** ADC SETUP */
 void adc_init(void) {
-    ADMUX = (1 << REFS0) | (1 << REFS1);    // Set Internal 1.1V Voltage Reference
-    ADCSRA = (1 << ADEN) | (1 << ADPS0)     // Enable ADC
-        | (1 << ADPS1) | (1 << ADPS2);      // prescaler 128 (125kHz ADC clock frequency)
+    ADMUX = (1 << REFS0) | (1 << REFS1)     // Set Internal 1.1V Voltage Reference
+        | 0x08;                             // Select ADC8 (temperature sensor)
+    ADCSRA = (1 << ADEN) | (1 << ADIE)      // Enable ADC & conversion complete interrupt (wake-up)
+        | (1 << ADPS0) | (1 << ADPS1) | (1 << ADPS2);   // prescaler 128 (125kHz ADC clock frequency)
+    SMCR = (1 << SM0);                      // Sleep mode = ADC Noise Reduction
+}
+
+ISR(ADC_vect) {                             // Only wakes the CPU up, result is read below
 }
 
 uint16_t adc_read_temp(void) {
-    ADMUX = (ADMUX & 0xF0) | 0x08;          // Select ADC0
-    ADCSRA |= (1 << ADSC);                  // Start conversion
-    while (ADCSRA & (1 << ADSC))            // Wait for conversion to complete
+    if (rx_active) {                        // Plain conversion, the CPU keeps running
+        ADCSRA |= (1 << ADSC);
+        while (ADCSRA & (1 << ADSC))
+            ;
+        return (ADC);
+    }
+    uart_flush();
+    SMCR |= (1 << SE);                      // Entering ADC Noise Reduction starts the conversion
+    do {                                    // with the CPU & I/O clocks halted
+        __asm__ __volatile__ ("sleep");
+    } while (ADCSRA & (1 << ADSC));         // Woken up by another interrupt : sleep again
+    SMCR &= ~(1 << SE);
+    return (ADC);                           // Read 10-bit ADC result (ADCL then ADCH)
+}
+
+uint16_t adc_read_average(void) {
+    uint16_t sum = 0;
+    for (uint8_t j = 0; j < NB_SAMPLES; j++)
+        sum += adc_read_temp();
+    return (sum / NB_SAMPLES);
+}
+
+// ************************************************************ EEPROM SETUP */
+unsigned char EEPROM_read(uint16_t address) {
+    while (EECR & (1 << EEPE))  // Wait for completion of previous write
+        ;
+    EEAR = address;             // Set up address register
+    EECR |= (1 << EERE);        // Start eeprom read by writing EERE
+    return (EEDR);              // Return data from Data Register
+}
+
+void EEPROM_write(uint16_t address, unsigned char data) {
+    while (EECR & (1 << EEPE))  // Wait for completion of previous write
         ;
-        return (ADCL | (ADCH << 8));        // Read 10-bit ADC result (ADCL + ADCH shifted left 8 bits)
+    EEAR = address;             // Set up address register
+    EEDR = data;                // Load data to register
+    cli();                      // EEMPE -> EEPE must be within 4 cycles
+    EECR |= (1 << EEMPE);       // Write logical 1 to eempe
+    EECR |= (1 << EEPE);        // Start eeprom write by setting EEPE
+    sei();
+}
+
+// ************************************************************* CALIBRATION */
+// Record : MAGIC_CALIB | gain (LSB, MSB) | offset (LSB, MSB) | checksum (XOR of the 4 bytes)
+void calib_load(void) {
+    uint8_t bytes[4];
+    uint8_t check = 0;
+    if (EEPROM_read(CALIB_ADDR) != MAGIC_CALIB)
+        return ;                            // Never calibrated : keep the default line
+    for (uint8_t j = 0; j < 4; j++) {
+        bytes[j] = EEPROM_read(CALIB_ADDR + 1 + j);
+        check ^= bytes[j];
+    }
+    if (check != EEPROM_read(CALIB_ADDR + 5))
+        return ;
+    gain = bytes[0] | (bytes[1] << 8);
+    offset = bytes[2] | (bytes[3] << 8);
+}
+
+void calib_save(void) {
+    uint8_t bytes[4] = {gain & 0xFF, gain >> 8, offset & 0xFF, offset >> 8};
+    uint8_t check = 0;
+    for (uint8_t j = 0; j < 4; j++) {
+        EEPROM_write(CALIB_ADDR + 1 + j, bytes[j]);
+        check ^= bytes[j];
+    }
+    EEPROM_write(CALIB_ADDR + 5, check);
+    EEPROM_write(CALIB_ADDR, MAGIC_CALIB);  // Written last : a cut record stays invalid
+}
+
+void calib_reset(void) {
+    gain = DEFAULT_GAIN;
+    offset = DEFAULT_OFFSET;
+    EEPROM_write(CALIB_ADDR, 0xFF);
+}
+
+// Two points (raw1, t1) & (raw2, t2) : gain = (t2 - t1) / (raw2 - raw1), offset = t1 - gain * raw1
+// Points closer than CAL_MIN_SPAN or a gain out of Q8.8 (|gain| >= 128 tenths/count) are refused
+uint8_t calib_compute(uint16_t raw, int16_t temp) {
+    int32_t span = (int32_t)raw - cal_raw;
+    if (span < CAL_MIN_SPAN && span > -CAL_MIN_SPAN)
+        return (0);
+    int32_t new_gain = (((int32_t)temp - cal_temp) << 8) / span;
+    if (new_gain > INT16_MAX || new_gain < INT16_MIN)
+        return (0);
+    int32_t new_offset = cal_temp - (((int32_t)cal_raw * new_gain) >> 8);
+    if (new_offset > INT16_MAX || new_offset < INT16_MIN)
+        return (0);
+    gain = new_gain;
+    offset = new_offset;
+    return (1);
 }
 
 // ********************************************************* CONVERT & PRINT */
-void ft_itoa(uint16_t value, char *dest) {  // itoa conversion
-    char tmp[5];
+void ft_itoa(int16_t value, char *dest) {   // itoa conversion
+    char tmp[6];
     uint8_t i = 0;
+    if (value < 0) {
+        *dest++ = '-';
+        value = -value;
+    }
     if (value == 0) {
         dest[0] = '0';
         dest[1] = '\0';
@@ -70,19 +216,18 @@ void print_result()
     uart_print_str("\n\r");
 }
 
-// y = mx + b (y = tension, m = pente, x = température, b = ordonnée à l'origine)
-// pour y = 347 (moyenne des valeurs de la tension)
-// m = 1,0643 (moyenne taux de variation entre 2 points)
-// x = 55 (moyenne des valeurs de la température en fonction de la tension)
-// On trouve b = 287,4
-// x1000 pour éviter les virgules
-// temperature = (((value * 1000) - 287400 ) / 1064)
-// Autre calcul : coef directeur * (valeur - point y de reference) + x de ref
-uint16_t convert(uint16_t value) {
-    return (((1064 * (value - 347)) / 1000) + 55);
+// y = mx + b (y = température, m = pente, x = tension, b = ordonnée à l'origine)
+// m & b viennent de la calibration (EEPROM) ou de la droite par défaut :
+// m = 1,064 (moyenne taux de variation entre 2 points), passant par (347, 55)
+// En virgule fixe : m en dixièmes de degré x256, b en dixièmes de degré
+int16_t convert(uint16_t value) {
+    int16_t tenths = (((int32_t)value * gain) >> 8) + offset;
+    return ((tenths + (tenths < 0 ? -5 : 5)) / 10);     // Round to nearest degree
 }
 
 // ******************************************************* TIMER & INTERRUPT */
+volatile uint8_t measure = 0;
+
 void timer0_init(void) {
     TCCR0B = (1 << CS01) | (1 << CS00);     // Prescaler 64
     TIMSK0 |= (1 << TOIE0);                 // Enable Timer0 overflow interrupt
@@ -93,18 +238,90 @@ ISR(TIMER0_OVF_vect) {                      // Timer 0 Compare Interrupt
     ovf_count++;
     if (ovf_count >= 20) {
         ovf_count = 0;
-        uint16_t celsius_value = convert(adc_read_temp());
-        ft_itoa(celsius_value, temp_str);
-        print_result();
+        measure = 1;                        // Sleeping must happen outside of any ISR
     }
 }
 
+// ********************************************************** INPUT HANDLING */
+uint8_t parse_temp(const char *str, int16_t *tenths) {  // [-]digits, CAL_TEMP_MIN..MAX
+    int16_t value = 0;
+    uint8_t neg = (*str == '-');
+    str += neg;
+    if (*str == '\0')
+        return (0);
+    while (*str >= '0' && *str <= '9' && value <= CAL_TEMP_MAX)
+        value = value * 10 + (*str++ - '0');
+    if (*str != '\0')
+        return (0);
+    value = neg ? -value : value;
+    if (value < CAL_TEMP_MIN || value > CAL_TEMP_MAX)
+        return (0);
+    *tenths = value * 10;
+    return (1);
+}
+
+
+// CAL1 <temp> : capture the first reference point (temp in C)
+// CAL2 <temp> : capture the second point, compute & store gain / offset
+// CALRESET    : back to the default line
+void print_response(char *color, char *str) {
+    uart_print_str(color);
+    uart_print_str(str);
+    uart_print_str(RESET);
+    uart_print_str("\n\r");
+}
+
+void handle_line() {
+    int16_t temp;
+    buf[i] = '\0';
+    i = 0;
+    if (strcmp(buf, "CALRESET") == 0) {
+        calib_reset();
+        print_response(GREEN, "Calibration reset");
+    } else if (strncmp(buf, "CAL1 ", 5) == 0 && parse_temp(&buf[5], &temp)) {
+        cal_temp = temp;
+        cal_raw = adc_read_average();
+        cal_step = 1;
+        print_response(GREEN, "Point 1 captured");
+    } else if (strncmp(buf, "CAL2 ", 5) == 0 && cal_step == 1 && parse_temp(&buf[5], &temp)) {
+        if (!calib_compute(adc_read_average(), temp)) {
+            print_response(RED, "Points too close or slope out of range");
+            return ;
+        }
+        calib_save();
+        cal_step = 0;
+        print_response(GREEN, "Calibration saved");
+    } else
+        print_response(RED, BAD_INPUT);
+}
+
+void handle_input() {
+    if (!(UCSR0A & (1 << RXC0)))            // Nothing received : never block
+        return ;
+    char c = UDR0;
+    rx_active = RX_QUIET;
+    if (c == '\n' || c == '\r') {
+        if (i > 0)
+            handle_line();
+    } else if (i < sizeof(buf) - 1)
+        buf[i++] = c;
+}
+
 int main() {
     uart_init();
     adc_init();
     timer0_init();
+    calib_load();
     sei();
-    while (1)
-        ;
+    while (1) {
+        handle_input();
+        if (measure) {
+            measure = 0;
+            if (rx_active)
+                rx_active--;
+            ft_itoa(convert(adc_read_average()), temp_str);
+            print_result();
+        }
+    }
     return (0);
 }
@@ -1,15 +1,15 @@
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 #define LED_R PD5
 #define LED_G PD6
 #define LED_B PD3
 #define MASK (PORTB & ~(0x07 | (1 << PB4)))
 
-#define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))     // Round to nearest integer
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define WHEEL_DELTA 2                       // Pot noise below this does not touch the RGB LED
+#define BAR_HYSTERESIS 3
 
 // *************************************************************** ADC SETUP */
 void adc_init(void) {
@@ -26,63 +26,252 @@ uint8_t adc_read(void) {
     return (ADCH);                          // Read 8-bit ADC result
 }
 
+// ************************************************************** ADC EVENTS */
+// Consumers only run on an event instead of on every sample :
+// - ADC_EV_CHANGE : value moved by at least `delta` since the last report (or hit 0 / 255)
+// - ADC_EV_LEVEL  : value crossed one of `thresholds`, with `hysteresis` on the way down
+#define ADC_EV_CHANGE   0x01
+#define ADC_EV_LEVEL    0x02
+
+typedef struct {
+    uint8_t value;                          // Last reported value
+    uint8_t delta;
+    uint8_t level;                          // Number of thresholds reached
+    uint8_t hysteresis;
+    uint8_t nb_thresholds;
+    const uint8_t *thresholds;              // Ascending
+} adc_event_t;
+
+uint8_t adc_event_update(adc_event_t *ev, uint8_t sample) {
+    uint8_t events = 0;
+    uint8_t diff = (sample > ev->value) ? sample - ev->value : ev->value - sample;
+
+    if (diff >= ev->delta || (diff && (sample == 0 || sample == 255))) {
+        ev->value = sample;
+        events |= ADC_EV_CHANGE;
+    }
+    uint8_t level = ev->level;
+    while (level < ev->nb_thresholds && sample >= ev->thresholds[level])
+        level++;
+    while (level > 0 && sample + ev->hysteresis < ev->thresholds[level - 1])
+        level--;
+    if (level != ev->level) {
+        ev->level = level;
+        events |= ADC_EV_LEVEL;
+    }
+    return (events);
+}
+
 // *************************************************************** RGB SETUP */
+// Channels are 16-bit (0 - 65535), gamma corrected from gamma16_table[] :
+// - Timer0 / Timer2 : 8-bit phase correct PWM (0 = really off, no fast PWM spike) at 3.9kHz,
+//   + DITHER_BITS of first order sigma-delta : TIMER0_OVF_vect adds the error of the previous
+//   periods & bumps the duty by 1 when it overflows, so the average is 12-bit and the
+//   pattern repeats at least every 16 periods (245Hz, no visible flicker)
+#define DITHER_BITS     4                   // 8 + 4 = 12-bit channels on the 8-bit timers
+#define DITHER_MASK     ((1 << DITHER_BITS) - 1)
+
+// Generated by module_03/ex02/gen_color_tables.py --gamma16 : gamma 2.8
+const uint16_t gamma16_table[256] PROGMEM = {
+        0,     0,     0,     0,     1,     1,     2,     3,
+        4,     6,     8,    10,    13,    16,    19,    24,
+       28,    33,    39,    46,    53,    60,    69,    78,
+       88,    98,   110,   122,   135,   149,   164,   179,
+      196,   214,   232,   252,   273,   295,   317,   341,
+      366,   393,   420,   449,   478,   510,   542,   575,
+      610,   647,   684,   723,   764,   806,   849,   894,
+      940,   988,  1037,  1088,  1140,  1194,  1250,  1307,
+     1366,  1427,  1489,  1553,  1619,  1686,  1756,  1827,
+     1900,  1975,  2051,  2130,  2210,  2293,  2377,  2463,
+     2552,  2642,  2734,  2829,  2925,  3024,  3124,  3227,
+     3332,  3439,  3548,  3660,  3774,  3890,  4008,  4128,
+     4251,  4376,  4504,  4634,  4766,  4901,  5038,  5177,
+     5319,  5464,  5611,  5760,  5912,  6067,  6224,  6384,
+     6546,  6711,  6879,  7049,  7222,  7397,  7576,  7757,
+     7941,  8128,  8317,  8509,  8704,  8902,  9103,  9307,
+     9514,  9723,  9936, 10151, 10370, 10591, 10816, 11043,
+    11274, 11507, 11744, 11984, 12227, 12473, 12722, 12975,
+    13230, 13489, 13751, 14017, 14285, 14557, 14833, 15111,
+    15393, 15678, 15967, 16259, 16554, 16853, 17155, 17461,
+    17770, 18083, 18399, 18719, 19042, 19369, 19700, 20034,
+    20372, 20713, 21058, 21407, 21759, 22115, 22475, 22838,
+    23206, 23577, 23952, 24330, 24713, 25099, 25489, 25884,
+    26282, 26683, 27089, 27499, 27913, 28330, 28752, 29178,
+    29608, 30041, 30479, 30921, 31367, 31818, 32272, 32730,
+    33193, 33660, 34131, 34606, 35085, 35569, 36057, 36549,
+    37046, 37547, 38052, 38561, 39075, 39593, 40116, 40643,
+    41175, 41711, 42251, 42796, 43346, 43899, 44458, 45021,
+    45588, 46161, 46737, 47319, 47905, 48495, 49091, 49691,
+    50295, 50905, 51519, 52138, 52761, 53390, 54023, 54661,
+    55303, 55951, 56604, 57261, 57923, 58590, 59262, 59939,
+    60621, 61308, 62000, 62697, 63399, 64106, 64818, 65535
+};
+
+volatile uint16_t rgb_level[3];             // 8.4 fixed point duty, read by TIMER0_OVF_vect
+
 void init_rgb() {
     DDRD |= (1 << LED_R) | (1 << LED_G) | (1 << LED_B);
 
     // Timer 0 config - LED_R & LED_G
     TCCR0A |= (1 << COM0A1) | (1 << COM0B1) // Set Compare Output Mode
-        | (1 << WGM00) | (1 << WGM01);      // Fast PWM mode
-    TCCR0B |= (1 << CS00);                  // No prescaler
+        | (1 << WGM00);                     // Phase correct PWM mode
+    TCCR0B |= (1 << CS01);                  // Prescaler 8 : 16MHz / 8 / 510 = 3.9kHz
+    TIMSK0 |= (1 << TOIE0);                 // Dither once per period (BOTTOM)
 
     // Timer 2 config - LED_B
     TCCR2A |= (1 << COM2B1)                 // Set Compare Output Mode
-        | (1 << WGM20) | (1 << WGM21);      // Fast PWM mode
-    TCCR2B |= (1 << CS20);                  // No prescaler
+        | (1 << WGM20);                     // Phase correct PWM mode
+    TCCR2B |= (1 << CS21);                  // Prescaler 8, same period as Timer0
+}
+
+uint8_t dither(uint16_t level, uint8_t *error) {    // Duty for the next period
+    uint8_t duty = level >> DITHER_BITS;
+    *error += level & DITHER_MASK;
+    if (*error > DITHER_MASK) {             // Accumulated error worth one step
+        *error -= DITHER_MASK + 1;
+        if (duty < 255)
+            duty++;
+    }
+    return (duty);
+}
+
+ISR(TIMER0_OVF_vect) {                      // OCRx are double buffered : used from the next period
+    static uint8_t error[3];
+    OCR0B = dither(rgb_level[0], &error[0]);
+    OCR0A = dither(rgb_level[1], &error[1]);
+    OCR2B = dither(rgb_level[2], &error[2]);
+}
+
+void set_rgb16(uint16_t r, uint16_t g, uint16_t b) {
+    cli();                                  // 16-bit levels must not be torn by the ISR
+    rgb_level[0] = r >> (8 - DITHER_BITS);
+    rgb_level[1] = g >> (8 - DITHER_BITS);
+    rgb_level[2] = b >> (8 - DITHER_BITS);
+    sei();
 }
 
 void set_rgb(uint8_t r, uint8_t g, uint8_t b) {
-    OCR0B = r;
-    OCR0A = g;
-    OCR2B = b;
+    set_rgb16(r * 257U, g * 257U, b * 257U);    // 0xFF -> 0xFFFF
 }
 
-void wheel(uint8_t pos) {                   // Generates a smooth color transition
-    pos = 255 - pos;                        // Inverts input value
-    if (pos < 85) {                         // RED
-        set_rgb(255 - pos * 3, 0, pos * 3); // Transitions from red to purple (mixing red and blue)
-    } else if (pos < 170) {                 // GREEN 
-        pos = pos - 85;
-        set_rgb(0, pos * 3, 255 - pos * 3); // Transitions from purple to green (mixing blue and green)
-    } else {
-        pos = pos - 170;                    // BLUE
-        set_rgb(pos * 3, 255 - pos * 3, 0); // Transitions from green to red (mixing red and green)
-    }
+// ******************************************************************* COLOR */
+// Tables from module_03/ex02/gen_color_tables.py, read from flash (3 cycles per LPM) :
+// - wheel()     : 3 table reads instead of compare + multiply branches
+// - set_color() : 8-bit color -> gamma16_table -> 16-bit level, dithered down to the PWM
+//   by the sigma-delta of RGB SETUP, so fades stay linear to the eye down to the darkest steps
+typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} rgb_t;
+
+const uint8_t wheel_table[256][3] PROGMEM = {
+    {255,   0,   0}, {252,   3,   0}, {249,   6,   0}, {246,   9,   0},
+    {243,  12,   0}, {240,  15,   0}, {237,  18,   0}, {234,  21,   0},
+    {231,  24,   0}, {228,  27,   0}, {225,  30,   0}, {222,  33,   0},
+    {219,  36,   0}, {216,  39,   0}, {213,  42,   0}, {210,  45,   0},
+    {207,  48,   0}, {204,  51,   0}, {201,  54,   0}, {198,  57,   0},
+    {195,  60,   0}, {192,  63,   0}, {189,  66,   0}, {186,  69,   0},
+    {183,  72,   0}, {180,  75,   0}, {177,  78,   0}, {174,  81,   0},
+    {171,  84,   0}, {168,  87,   0}, {165,  90,   0}, {162,  93,   0},
+    {159,  96,   0}, {156,  99,   0}, {153, 102,   0}, {150, 105,   0},
+    {147, 108,   0}, {144, 111,   0}, {141, 114,   0}, {138, 117,   0},
+    {135, 120,   0}, {132, 123,   0}, {129, 126,   0}, {126, 129,   0},
+    {123, 132,   0}, {120, 135,   0}, {117, 138,   0}, {114, 141,   0},
+    {111, 144,   0}, {108, 147,   0}, {105, 150,   0}, {102, 153,   0},
+    { 99, 156,   0}, { 96, 159,   0}, { 93, 162,   0}, { 90, 165,   0},
+    { 87, 168,   0}, { 84, 171,   0}, { 81, 174,   0}, { 78, 177,   0},
+    { 75, 180,   0}, { 72, 183,   0}, { 69, 186,   0}, { 66, 189,   0},
+    { 63, 192,   0}, { 60, 195,   0}, { 57, 198,   0}, { 54, 201,   0},
+    { 51, 204,   0}, { 48, 207,   0}, { 45, 210,   0}, { 42, 213,   0},
+    { 39, 216,   0}, { 36, 219,   0}, { 33, 222,   0}, { 30, 225,   0},
+    { 27, 228,   0}, { 24, 231,   0}, { 21, 234,   0}, { 18, 237,   0},
+    { 15, 240,   0}, { 12, 243,   0}, {  9, 246,   0}, {  6, 249,   0},
+    {  3, 252,   0}, {  0, 255,   0}, {  0, 252,   3}, {  0, 249,   6},
+    {  0, 246,   9}, {  0, 243,  12}, {  0, 240,  15}, {  0, 237,  18},
+    {  0, 234,  21}, {  0, 231,  24}, {  0, 228,  27}, {  0, 225,  30},
+    {  0, 222,  33}, {  0, 219,  36}, {  0, 216,  39}, {  0, 213,  42},
+    {  0, 210,  45}, {  0, 207,  48}, {  0, 204,  51}, {  0, 201,  54},
+    {  0, 198,  57}, {  0, 195,  60}, {  0, 192,  63}, {  0, 189,  66},
+    {  0, 186,  69}, {  0, 183,  72}, {  0, 180,  75}, {  0, 177,  78},
+    {  0, 174,  81}, {  0, 171,  84}, {  0, 168,  87}, {  0, 165,  90},
+    {  0, 162,  93}, {  0, 159,  96}, {  0, 156,  99}, {  0, 153, 102},
+    {  0, 150, 105}, {  0, 147, 108}, {  0, 144, 111}, {  0, 141, 114},
+    {  0, 138, 117}, {  0, 135, 120}, {  0, 132, 123}, {  0, 129, 126},
+    {  0, 126, 129}, {  0, 123, 132}, {  0, 120, 135}, {  0, 117, 138},
+    {  0, 114, 141}, {  0, 111, 144}, {  0, 108, 147}, {  0, 105, 150},
+    {  0, 102, 153}, {  0,  99, 156}, {  0,  96, 159}, {  0,  93, 162},
+    {  0,  90, 165}, {  0,  87, 168}, {  0,  84, 171}, {  0,  81, 174},
+    {  0,  78, 177}, {  0,  75, 180}, {  0,  72, 183}, {  0,  69, 186},
+    {  0,  66, 189}, {  0,  63, 192}, {  0,  60, 195}, {  0,  57, 198},
+    {  0,  54, 201}, {  0,  51, 204}, {  0,  48, 207}, {  0,  45, 210},
+    {  0,  42, 213}, {  0,  39, 216}, {  0,  36, 219}, {  0,  33, 222},
+    {  0,  30, 225}, {  0,  27, 228}, {  0,  24, 231}, {  0,  21, 234},
+    {  0,  18, 237}, {  0,  15, 240}, {  0,  12, 243}, {  0,   9, 246},
+    {  0,   6, 249}, {  0,   3, 252}, {  0,   0, 255}, {  3,   0, 252},
+    {  6,   0, 249}, {  9,   0, 246}, { 12,   0, 243}, { 15,   0, 240},
+    { 18,   0, 237}, { 21,   0, 234}, { 24,   0, 231}, { 27,   0, 228},
+    { 30,   0, 225}, { 33,   0, 222}, { 36,   0, 219}, { 39,   0, 216},
+    { 42,   0, 213}, { 45,   0, 210}, { 48,   0, 207}, { 51,   0, 204},
+    { 54,   0, 201}, { 57,   0, 198}, { 60,   0, 195}, { 63,   0, 192},
+    { 66,   0, 189}, { 69,   0, 186}, { 72,   0, 183}, { 75,   0, 180},
+    { 78,   0, 177}, { 81,   0, 174}, { 84,   0, 171}, { 87,   0, 168},
+    { 90,   0, 165}, { 93,   0, 162}, { 96,   0, 159}, { 99,   0, 156},
+    {102,   0, 153}, {105,   0, 150}, {108,   0, 147}, {111,   0, 144},
+    {114,   0, 141}, {117,   0, 138}, {120,   0, 135}, {123,   0, 132},
+    {126,   0, 129}, {129,   0, 126}, {132,   0, 123}, {135,   0, 120},
+    {138,   0, 117}, {141,   0, 114}, {144,   0, 111}, {147,   0, 108},
+    {150,   0, 105}, {153,   0, 102}, {156,   0,  99}, {159,   0,  96},
+    {162,   0,  93}, {165,   0,  90}, {168,   0,  87}, {171,   0,  84},
+    {174,   0,  81}, {177,   0,  78}, {180,   0,  75}, {183,   0,  72},
+    {186,   0,  69}, {189,   0,  66}, {192,   0,  63}, {195,   0,  60},
+    {198,   0,  57}, {201,   0,  54}, {204,   0,  51}, {207,   0,  48},
+    {210,   0,  45}, {213,   0,  42}, {216,   0,  39}, {219,   0,  36},
+    {222,   0,  33}, {225,   0,  30}, {228,   0,  27}, {231,   0,  24},
+    {234,   0,  21}, {237,   0,  18}, {240,   0,  15}, {243,   0,  12},
+    {246,   0,   9}, {249,   0,   6}, {252,   0,   3}, {255,   0,   0}
+};
+
+rgb_t wheel(uint8_t pos) {                  // Smooth red -> purple -> green -> red transition
+    const uint8_t *p = wheel_table[pos];
+    rgb_t c = {pgm_read_byte(p), pgm_read_byte(p + 1), pgm_read_byte(p + 2)};
+    return (c);
+}
+
+void set_color(rgb_t c) {                   // Gamma corrected output, 16-bit
+    set_rgb16(pgm_read_word(&gamma16_table[c.r]), pgm_read_word(&gamma16_table[c.g]),
+        pgm_read_word(&gamma16_table[c.b]));
 }
 
 // ******************************************************************** LEDS */
-void display(uint8_t value)
+const uint8_t bar_thresholds[] = {64, 128, 192, 255};
+const uint8_t bar_leds[] = {0x00, 0x01, 0x03, 0x07, 0x07 | (1 << PB4)};
+
+void display(uint8_t level)                 // Number of thresholds reached = LEDs on
 {
-    if (value < 64)
-        PORTB = MASK;
-    else if (value > 63 && value < 128)
-        PORTB = MASK | 0x01;
-    else if (value > 127 && value < 192)
-        PORTB = MASK | 0x03;
-    else if (value > 191 && value < 255)
-        PORTB = MASK | 0x07;
-    else if (value == 255)
-        PORTB = 0x07 | (1 << PB4);
+    PORTB = MASK | bar_leds[level];
 }
 
 int main() {
     DDRB |= (1 << PB0) | (1 << PB1) | (1 << PB2) | (1 << PB4);
     init_rgb();
     adc_init();
+    sei();                                  // Dithering runs from TIMER0_OVF_vect
+    adc_event_t pot = {
+        .delta = WHEEL_DELTA,
+        .hysteresis = BAR_HYSTERESIS,
+        .nb_thresholds = sizeof(bar_thresholds),
+        .thresholds = bar_thresholds
+    };
+    adc_event_update(&pot, adc_read());
+    set_color(wheel(pot.value));            // Initial state, then only on events
+    display(pot.level);
     while (1) {
-        uint8_t value = adc_read();
-        wheel(value);
-        display(value);
+        uint8_t events = adc_event_update(&pot, adc_read());
+        if (events & ADC_EV_CHANGE)
+            set_color(wheel(pot.value));
+        if (events & ADC_EV_LEVEL)
+            display(pot.level);
     }
     return (0);
 }
@@ -1,21 +1,44 @@
 #include <avr/io.h>
 #include <util/twi.h>
 #include <util/delay.h>
+#include <avr/interrupt.h>
 
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))     // Round to nearest int
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
 
 #define SLA_ADDR 0x38
 #define SLA_W (SLA_ADDR << 1) | 0           // 0x70 = 8-bit address for write
 #define SLA_R ((SLA_ADDR << 1) | 1)         // 0x71 = 8-bit address for read
 
+#define TOP_TIMER0 (F_CPU / 64UL / 1000 - 1)  // 1ms interrupt period = 249
+#define AHT20_BUSY 0x80                     // Status bit 7 : measurement in progress
+#define AHT20_FIRST_POLL_MS 40              // Conversion never completes before this
+#define AHT20_POLL_MS 5                     // Status polling interval while busy
+#define AHT20_TIMEOUT_MS 150                // Give up on a conversion after this
+
 uint8_t data[7];
 
 // ************************************************************** UART SETUP */
 void uart_init() {
     UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)MYUBRR;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
     
     UCSR0B = (1 << TXEN0);                  // Enable transmitter
     UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // Set frame format to 8N1 (8-bit frame, 1 stop bit, no parity)
@@ -127,6 +150,8 @@ void i2c_init(void) {
 void i2c_stop(void) {
     TWCR = (1 << TWINT) | (1 << TWEN)       // Transmit STOP condition
         | (1 << TWSTO);
+    while (TWCR & (1 << TWSTO))             // Cleared once STOP is on the bus : a START issued
+        ;                                   // before that would be lost
 }
 
 // ************************************************ I2C WRITE - READ - PRINT */
@@ -143,6 +168,12 @@ void i2c_read(void) {
         ;
 }
 
+void i2c_read_nack(void) {                  // Last byte of a read : NACK so the slave releases SDA
+    TWCR = (1 << TWINT) | (1 << TWEN);
+    while (!(TWCR & (1 << TWINT)))
+        ;
+}
+
 void print_hex_value(char c) {
     const char hex_chars[] = "0123456789ABCDEF";
     uart_tx(hex_chars[(c >> 4) & 0x0F]);    // Extract upper and lower 4 bits + convert to hex
@@ -150,28 +181,110 @@ void print_hex_value(char c) {
     uart_tx(' ');
 }
 
+// ************************************************************* SYSTEM TICK */
+volatile uint16_t ms_ticks = 0;
+
+void timer0_init(void) {
+    TCCR0A = (1 << WGM01);                  // CTC Mode
+    TCCR0B = (1 << CS01) | (1 << CS00);     // Prescaler 64
+    OCR0A = TOP_TIMER0;                     // Interrupt every 1ms
+    TIMSK0 |= (1 << OCIE0A);                // Enable Timer0 Compare Match A Interrupt
+}
+
+ISR(TIMER0_COMPA_vect) {
+    ms_ticks++;
+}
+
+uint16_t millis(void) {
+    uint16_t now;
+    cli();                                  // 16-bit read must not be torn by the ISR
+    now = ms_ticks;
+    sei();
+    return (now);
+}
+
+// ***************************************************** AHT20 STATE MACHINE */
+typedef enum {
+    AHT20_TRIGGER,                          // Send 0xAC 0x33 0x00
+    AHT20_WAIT,                             // Poll status bit 7 until the conversion is done
+    AHT20_READ                              // Read the 7 bytes frame & print it
+} aht20_state_t;
+
+aht20_state_t aht20_state = AHT20_TRIGGER;
+uint16_t aht20_start = 0;                   // Tick at which the measurement was triggered
+uint16_t aht20_poll = 0;                    // Tick of the last status poll
+
+uint8_t aht20_status(void) {
+    i2c_start();
+    i2c_write(SLA_R);
+    i2c_read_nack();
+    uint8_t status = TWDR;
+    i2c_stop();
+    return (status);
+}
+
+void aht20_trigger(void) {
+    i2c_start();
+    i2c_write(SLA_W);
+    i2c_write(0xAC);                        // "Send the 0xAC command"
+    i2c_write(0x33);
+    i2c_write(0x00);
+    i2c_stop();
+}
+
+void aht20_read(void) {
+    i2c_start();
+    i2c_write(SLA_R);
+    for (uint8_t i = 0; i < 6; i++) {       // Read 6 bytes (sending ACK after each)
+        i2c_read();
+        data[i] = TWDR;                     // Store received byte
+    }
+    i2c_read_nack();                        // 7th byte = CRC
+    data[6] = TWDR;
+    i2c_stop();
+}
+
+void aht20_task(void) {                     // Never blocks longer than one I2C transfer
+    uint16_t now = millis();
+
+    switch (aht20_state) {
+        case AHT20_TRIGGER:
+            aht20_trigger();
+            aht20_start = now;
+            aht20_poll = now;
+            aht20_state = AHT20_WAIT;
+            break;
+        case AHT20_WAIT:
+            if ((uint16_t)(now - aht20_start) < AHT20_FIRST_POLL_MS
+                || (uint16_t)(now - aht20_poll) < AHT20_POLL_MS)
+                break;
+            aht20_poll = now;
+            if (!(aht20_status() & AHT20_BUSY))
+                aht20_state = AHT20_READ;
+            else if ((uint16_t)(now - aht20_start) >= AHT20_TIMEOUT_MS)
+                aht20_state = AHT20_TRIGGER;    // Sensor stuck : start over
+            break;
+        case AHT20_READ:
+            aht20_read();
+            for (uint8_t i = 0; i < 7; i++)
+                print_hex_value(data[i]);
+            uart_printstr("\r\n");
+            aht20_state = AHT20_TRIGGER;    // Next measurement right away
+            break;
+    }
+}
+
 int main() {
     uart_init();
     i2c_init();
+    timer0_init();
+    sei();
+    _delay_ms(40);                          // "Wait 40ms after power-on"
     i2c_start();
     i2c_calibrate();
     while (1) {
-        i2c_start();
-        i2c_write(SLA_W); 
-        i2c_write(0xAC);                    // "Send the 0xAC command"
-        i2c_write(0x33);
-        i2c_write(0x00);
-        _delay_ms(80);                      // "Wait for 80ms to wait for the measurement to be completed"
-        i2c_start();
-        i2c_write(SLA_R);
-        for (uint8_t i = 0; i < 7; i++) {   // Read 6 bytes (sending ACK after each)
-            i2c_read();
-            data[i] = TWDR;                 // Store received byte
-        }
-        for (uint8_t i = 0; i < 7; i++)
-            print_hex_value(data[i]);
-        uart_printstr("\r\n");
-        i2c_stop();
+        aht20_task();
+        // Free for other tasks while the sensor converts
     }
     return (0);
 }
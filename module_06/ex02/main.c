@@ -1,21 +1,50 @@
 #include <avr/io.h>
 #include <util/twi.h>
 #include <util/delay.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <stdlib.h>
 
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))     // Round to nearest int
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
 
 #define SLA_ADDR 0x38
 #define SLA_W (SLA_ADDR << 1) | 0           // 0x70 = 8-bit address for write
 #define SLA_R ((SLA_ADDR << 1) | 1)         // 0x71 = 8-bit address for read
 
+#define TOP_TIMER0 (F_CPU / 64UL / 1000 - 1)  // 1ms interrupt period = 249
+#define AHT20_BUSY 0x80                     // Status bit 7 : measurement in progress
+#define AHT20_FIRST_POLL_MS 40              // Conversion never completes before this
+#define AHT20_POLL_MS 5                     // Status polling interval while busy
+#define AHT20_TIMEOUT_MS 150                // Give up on a conversion after this
+#define AHT20_MAX_RETRY 3                   // Frame re-reads on CRC mismatch before a new trigger
+
 uint8_t data[7];
+uint16_t crc_errors = 0;                    // Frames rejected by the CRC check
+uint16_t busy_errors = 0;                   // Frames read while the sensor was still busy
+uint16_t timeouts = 0;                      // Conversions that never completed
 
 // ************************************************************** UART SETUP */
 void uart_init() {
     UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)MYUBRR;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
     
     UCSR0B = (1 << TXEN0);                  // Enable transmitter
     UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // Set frame format to 8N1 (8-bit frame, 1 stop bit, no parity)
@@ -127,6 +156,8 @@ void i2c_init(void) {
 void i2c_stop(void) {
     TWCR = (1 << TWINT) | (1 << TWEN)       // Transmit STOP condition
         | (1 << TWSTO);
+    while (TWCR & (1 << TWSTO))             // Cleared once STOP is on the bus : a START issued
+        ;                                   // before that would be lost
 }
 
 // ******************************************************* I2C WRITE - READ  */
@@ -143,39 +174,127 @@ void i2c_read(void) {
         ;
 }
 
-// *********************************************************** I2C GET DATA  */
-#include <stdlib.h>
+void i2c_read_nack(void) {                  // Last byte of a read : NACK so the slave releases SDA
+    TWCR = (1 << TWINT) | (1 << TWEN);
+    while (!(TWCR & (1 << TWINT)))
+        ;
+}
+
+// ***************************************************************** FILTERS */
+// Per-channel smoothing, integer only :
+// - FILTER_AVERAGE : moving average over `size` samples, running sum updated in O(1)
+// - FILTER_MEDIAN  : median of the last `size` samples (rejects isolated spikes)
+// - FILTER_EMA     : exponential moving average, alpha = 1 / 2^shift
+#define FILTER_MAX_SIZE 8
 
-uint8_t i = 0;
-int32_t humid[3];
-int32_t temp[3];
+typedef int32_t sample_t;                  // 20-bit raw AHT20 values
+typedef int32_t acc_t;
 
-void assign_values(int32_t *values, int32_t new) {
-    if (i > 2) {
-        values[0] = values[1];
-        values[1] = values[2];
-        values[2] = new;
+typedef enum {
+    FILTER_NONE,
+    FILTER_AVERAGE,
+    FILTER_MEDIAN,
+    FILTER_EMA
+} filter_mode_t;
+
+typedef struct {
+    filter_mode_t mode;
+    uint8_t size;                           // Window length (AVERAGE / MEDIAN)
+    uint8_t shift;                          // Alpha shift (EMA)
+    uint8_t head;                           // Next slot to overwrite in the circular buffer
+    uint8_t count;                          // Samples received, saturates at size
+    acc_t sum;                              // Running sum of the window (AVERAGE), value << shift (EMA)
+    sample_t window[FILTER_MAX_SIZE];
+} filter_t;
+
+void filter_init(filter_t *f, filter_mode_t mode, uint8_t param) {
+    f->mode = mode;
+    f->size = 1;
+    f->shift = 0;
+    if (mode == FILTER_EMA)
+        f->shift = param;
+    else if (mode != FILTER_NONE)
+        f->size = (param == 0 || param > FILTER_MAX_SIZE) ? FILTER_MAX_SIZE : param;
+    f->head = 0;
+    f->count = 0;
+    f->sum = 0;
+}
+
+uint8_t filter_ready(const filter_t *f) {   // Window full : output is meaningful
+    return (f->count >= f->size);
+}
+
+sample_t filter_median(const filter_t *f) {
+    sample_t sorted[FILTER_MAX_SIZE];
+    for (uint8_t j = 0; j < f->count; j++) {  // Insertion sort, N <= FILTER_MAX_SIZE
+        sample_t v = f->window[j];
+        uint8_t k = j;
+        while (k > 0 && sorted[k - 1] > v) {
+            sorted[k] = sorted[k - 1];
+            k--;
+        }
+        sorted[k] = v;
     }
-    else if (i <= 2)
-        values[i] = new;
+    return (sorted[(f->count - 1) / 2]);
+}
+
+sample_t filter_push(filter_t *f, sample_t value) {
+    switch (f->mode) {
+        case FILTER_AVERAGE:
+            if (f->count == f->size)
+                f->sum -= f->window[f->head]; // Drop the oldest sample from the running sum
+            else
+                f->count++;
+            f->window[f->head] = value;
+            f->sum += value;
+            f->head = (f->head + 1 == f->size) ? 0 : f->head + 1;
+            return (f->sum / f->count);
+        case FILTER_MEDIAN:
+            if (f->count < f->size)
+                f->count++;
+            f->window[f->head] = value;
+            f->head = (f->head + 1 == f->size) ? 0 : f->head + 1;
+            return (filter_median(f));
+        case FILTER_EMA:
+            if (f->count == 0) {
+                f->count = 1;
+                f->sum = (acc_t)value << f->shift;  // Start from the first sample, not from 0
+            } else
+                f->sum += value - (sample_t)(f->sum >> f->shift);
+            return (f->sum >> f->shift);
+        default:
+            f->count = 1;
+            return (value);
+    }
+}
+
+// *********************************************************** I2C GET DATA  */
+filter_t humid_filter;
+filter_t temp_filter;
+sample_t humid;                             // Last filtered raw humidity
+sample_t temp;                              // Last filtered raw temperature
+
+void filters_init() {                       // Filter of each channel, cf. FILTER_* modes
+    filter_init(&humid_filter, FILTER_AVERAGE, 3);  // Average of the last 3 measurements
+    filter_init(&temp_filter, FILTER_AVERAGE, 3);
 }
 
 void get_humid() {
-    int32_t new_humid;
+    int32_t new_humid = 0;
     new_humid |= (int32_t)data[1] << 12;
     new_humid |=(int32_t)data[2] << 4;
-    new_humid |= (int32_t)(data[3] & 0x0F) >> 4;
+    new_humid |= (int32_t)(data[3] & 0xF0) >> 4;
     new_humid &= 0x000FFFFF;
-    assign_values(humid, new_humid);
+    humid = filter_push(&humid_filter, new_humid);
 }
 
 void get_temp() {
-    int32_t new_temp;
+    int32_t new_temp = 0;
     new_temp |= (int32_t)(data[3] & 0x0F) << 16;
     new_temp |= (int32_t)data[4] << 8;
     new_temp |= (int32_t)data[5];
     new_temp &= 0x000FFFFF;
-    assign_values(temp, new_temp);
+    temp = filter_push(&temp_filter, new_temp);
 }
 
 void collect_data() {   // Extract temp & humidity from received bytes
@@ -183,59 +302,219 @@ void collect_data() {   // Extract temp & humidity from received bytes
     get_temp();
 }
 
+void print_errors() {
+    char nb[6];
+    uart_printstr(" (CRC errors: ");
+    uart_printstr(utoa(crc_errors, nb, 10));
+    uart_printstr(", busy: ");
+    uart_printstr(utoa(busy_errors, nb, 10));
+    uart_printstr(", timeouts: ");
+    uart_printstr(utoa(timeouts, nb, 10));
+    uart_printstr(")");
+}
+
 void print_result(char *humid_str, char *temp_str) {
     uart_printstr("Temperature: ");
     uart_printstr(temp_str);
     uart_printstr(".C, Humidity: ");
     uart_printstr(humid_str);
-    uart_printstr("%\r\n");
+    uart_printstr("%");
+    if (crc_errors || busy_errors || timeouts)
+        print_errors();
+    uart_printstr("\r\n");
 }
 
 void convert_and_display() {
-    if (i < 2) {
+    if (!filter_ready(&humid_filter) || !filter_ready(&temp_filter)) {
         print_result("(N/A) - ", "(N/A) - ");
         return ;
     }
-    // Average of the last 3 measurements
-    float humid_average = (float)(humid[0] + humid[1] + humid[2]) / 3.0;
-    float temp_average = (float)(temp[0] + temp[1] + temp[2]) / 3.0;
-
-    // Conversion (cf. AHT20 datasheet)
-    humid_average = (humid_average / 1048576.0) * 100.0;
-    temp_average = (temp_average / 1048576.0) * 200.0 - 50.0;
+    // Conversion (cf. AHT20 datasheet), fixed-point :
+    // RH = raw * 100 / 2^20 (%), T = raw * 2000 / 2^20 - 500 = raw * 125 / 2^16 - 500 (0.1 C)
+    int16_t humid_pct = (int16_t)((humid * 100 + (1L << 19)) >> 20);
+    int16_t temp_dc = (int16_t)(((temp * 125 + (1L << 15)) >> 16) - 500);
 
-    // Float to str
+    // Int to str
     char humid_str[5];
-    char temp_str[4];
-    dtostrf(humid_average, 1, 0, humid_str);    // Min size == 4, precision == 1 (accuracy error = +/- 2)
-    dtostrf(temp_average, 3, 1, temp_str);      // Min size == 1, precision == 0 (accuracy errr = +/- 0.3)
+    char temp_str[8];
+    char *p = temp_str;
+    itoa(humid_pct, humid_str, 10);         // Precision == 0 (accuracy error = +/- 2)
+    if (temp_dc < 0) {                      // Precision == 1 (accuracy error = +/- 0.3)
+        *p++ = '-';
+        temp_dc = -temp_dc;
+    }
+    utoa(temp_dc / 10, p, 10);
+    while (*p)
+        p++;
+    *p++ = '.';
+    *p++ = '0' + temp_dc % 10;
+    *p = '\0';
     print_result(humid_str, temp_str);
 }
 
+// ************************************************************* SYSTEM TICK */
+volatile uint16_t ms_ticks = 0;
+
+void timer0_init(void) {
+    TCCR0A = (1 << WGM01);                  // CTC Mode
+    TCCR0B = (1 << CS01) | (1 << CS00);     // Prescaler 64
+    OCR0A = TOP_TIMER0;                     // Interrupt every 1ms
+    TIMSK0 |= (1 << OCIE0A);                // Enable Timer0 Compare Match A Interrupt
+}
+
+ISR(TIMER0_COMPA_vect) {
+    ms_ticks++;
+}
+
+uint16_t millis(void) {
+    uint16_t now;
+    cli();                                  // 16-bit read must not be torn by the ISR
+    now = ms_ticks;
+    sei();
+    return (now);
+}
+
+// ***************************************************** AHT20 STATE MACHINE */
+typedef enum {
+    AHT20_TRIGGER,                          // Send 0xAC 0x33 0x00
+    AHT20_WAIT,                             // Poll status bit 7 until the conversion is done
+    AHT20_READ                              // Read the 7 bytes frame & check it
+} aht20_state_t;
+
+aht20_state_t aht20_state = AHT20_TRIGGER;
+uint16_t aht20_start = 0;                   // Tick at which the measurement was triggered
+uint16_t aht20_poll = 0;                    // Tick of the last status poll
+uint8_t aht20_retry = 0;                    // Re-reads done for the current measurement
+
+// CRC-8, polynomial 0x31 (x^8 + x^5 + x^4 + 1), init 0xFF (cf. AHT20 datasheet)
+// crc8_table[n] = CRC of byte n, so each byte costs one flash lookup
+const uint8_t crc8_table[256] PROGMEM = {
+    0x00, 0x31, 0x62, 0x53, 0xC4, 0xF5, 0xA6, 0x97,
+    0xB9, 0x88, 0xDB, 0xEA, 0x7D, 0x4C, 0x1F, 0x2E,
+    0x43, 0x72, 0x21, 0x10, 0x87, 0xB6, 0xE5, 0xD4,
+    0xFA, 0xCB, 0x98, 0xA9, 0x3E, 0x0F, 0x5C, 0x6D,
+    0x86, 0xB7, 0xE4, 0xD5, 0x42, 0x73, 0x20, 0x11,
+    0x3F, 0x0E, 0x5D, 0x6C, 0xFB, 0xCA, 0x99, 0xA8,
+    0xC5, 0xF4, 0xA7, 0x96, 0x01, 0x30, 0x63, 0x52,
+    0x7C, 0x4D, 0x1E, 0x2F, 0xB8, 0x89, 0xDA, 0xEB,
+    0x3D, 0x0C, 0x5F, 0x6E, 0xF9, 0xC8, 0x9B, 0xAA,
+    0x84, 0xB5, 0xE6, 0xD7, 0x40, 0x71, 0x22, 0x13,
+    0x7E, 0x4F, 0x1C, 0x2D, 0xBA, 0x8B, 0xD8, 0xE9,
+    0xC7, 0xF6, 0xA5, 0x94, 0x03, 0x32, 0x61, 0x50,
+    0xBB, 0x8A, 0xD9, 0xE8, 0x7F, 0x4E, 0x1D, 0x2C,
+    0x02, 0x33, 0x60, 0x51, 0xC6, 0xF7, 0xA4, 0x95,
+    0xF8, 0xC9, 0x9A, 0xAB, 0x3C, 0x0D, 0x5E, 0x6F,
+    0x41, 0x70, 0x23, 0x12, 0x85, 0xB4, 0xE7, 0xD6,
+    0x7A, 0x4B, 0x18, 0x29, 0xBE, 0x8F, 0xDC, 0xED,
+    0xC3, 0xF2, 0xA1, 0x90, 0x07, 0x36, 0x65, 0x54,
+    0x39, 0x08, 0x5B, 0x6A, 0xFD, 0xCC, 0x9F, 0xAE,
+    0x80, 0xB1, 0xE2, 0xD3, 0x44, 0x75, 0x26, 0x17,
+    0xFC, 0xCD, 0x9E, 0xAF, 0x38, 0x09, 0x5A, 0x6B,
+    0x45, 0x74, 0x27, 0x16, 0x81, 0xB0, 0xE3, 0xD2,
+    0xBF, 0x8E, 0xDD, 0xEC, 0x7B, 0x4A, 0x19, 0x28,
+    0x06, 0x37, 0x64, 0x55, 0xC2, 0xF3, 0xA0, 0x91,
+    0x47, 0x76, 0x25, 0x14, 0x83, 0xB2, 0xE1, 0xD0,
+    0xFE, 0xCF, 0x9C, 0xAD, 0x3A, 0x0B, 0x58, 0x69,
+    0x04, 0x35, 0x66, 0x57, 0xC0, 0xF1, 0xA2, 0x93,
+    0xBD, 0x8C, 0xDF, 0xEE, 0x79, 0x48, 0x1B, 0x2A,
+    0xC1, 0xF0, 0xA3, 0x92, 0x05, 0x34, 0x67, 0x56,
+    0x78, 0x49, 0x1A, 0x2B, 0xBC, 0x8D, 0xDE, 0xEF,
+    0x82, 0xB3, 0xE0, 0xD1, 0x46, 0x77, 0x24, 0x15,
+    0x3B, 0x0A, 0x59, 0x68, 0xFF, 0xCE, 0x9D, 0xAC
+};
+
+uint8_t aht20_crc8(const uint8_t *buf, uint8_t len) {
+    uint8_t crc = 0xFF;
+    while (len--)
+        crc = pgm_read_byte(&crc8_table[crc ^ *buf++]);
+    return (crc);
+}
+
+uint8_t aht20_status(void) {
+    i2c_start();
+    i2c_write(SLA_R);
+    i2c_read_nack();
+    uint8_t status = TWDR;
+    i2c_stop();
+    return (status);
+}
+
+void aht20_trigger(void) {
+    i2c_start();
+    i2c_write(SLA_W);
+    i2c_write(0xAC);                        // "Send the 0xAC command"
+    i2c_write(0x33);
+    i2c_write(0x00);
+    i2c_stop();
+}
+
+uint8_t aht20_read(void) {                  // Return 1 if the frame is complete & valid
+    i2c_start();
+    i2c_write(SLA_R);
+    for (uint8_t j = 0; j < 6; j++) {       // Read 6 bytes (sending ACK after each)
+        i2c_read();
+        data[j] = TWDR;                     // Store received byte
+    }
+    i2c_read_nack();                        // 7th byte = CRC
+    data[6] = TWDR;
+    i2c_stop();
+    if (data[0] & AHT20_BUSY) {
+        busy_errors++;
+        return (0);
+    }
+    if (aht20_crc8(data, 6) != data[6]) {
+        crc_errors++;
+        return (0);
+    }
+    return (1);
+}
+
+void aht20_task(void) {                     // Never blocks longer than one I2C transfer
+    uint16_t now = millis();
+
+    switch (aht20_state) {
+        case AHT20_TRIGGER:
+            aht20_trigger();
+            aht20_start = now;
+            aht20_poll = now;
+            aht20_retry = 0;
+            aht20_state = AHT20_WAIT;
+            break;
+        case AHT20_WAIT:
+            if ((uint16_t)(now - aht20_start) < AHT20_FIRST_POLL_MS
+                || (uint16_t)(now - aht20_poll) < AHT20_POLL_MS)
+                break;
+            aht20_poll = now;
+            if (!(aht20_status() & AHT20_BUSY))
+                aht20_state = AHT20_READ;
+            else if ((uint16_t)(now - aht20_start) >= AHT20_TIMEOUT_MS) {
+                timeouts++;
+                aht20_state = AHT20_TRIGGER;    // Sensor stuck : start over
+            }
+            break;
+        case AHT20_READ:
+            if (aht20_read()) {
+                collect_data();
+                convert_and_display();
+            } else if (aht20_retry++ < AHT20_MAX_RETRY)
+                break;                      // Corrupted transfer : read the same frame again
+            aht20_state = AHT20_TRIGGER;    // Next measurement right away
+            break;
+    }
+}
+
 int main() {
     uart_init();
     i2c_init();
+    timer0_init();
+    filters_init();
+    sei();
+    _delay_ms(40);                          // "Wait 40ms after power-on"
     i2c_start();
     i2c_calibrate();
     while (1) {
-        i2c_start();
-        i2c_write(SLA_W); 
-        i2c_write(0xAC);                    // "Send the 0xAC command"
-        i2c_write(0x33);
-        i2c_write(0x00);
-        _delay_ms(80);                      // "Wait for 80ms to wait for the measurement to be completed"
-        i2c_start();
-        i2c_write(SLA_R);
-        for (uint8_t i = 0; i < 7; i++) {   // Read 6 bytes (sending ACK after each)
-            i2c_read();
-            data[i] = TWDR;                 // Store received byte
-        }
-        collect_data();
-        convert_and_display();
-        i++;
-        if (i == 255)
-        i = 3;
-        i2c_stop();
+        aht20_task();
+        // Free for other tasks while the sensor converts
     }
     return (0);
-}
\ No newline at end of file
+}
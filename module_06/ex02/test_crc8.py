@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# Host check of the AHT20 CRC-8 in main.c : crc8_table[] against the bitwise
+# CRC (poly 0x31, init 0xFF), then every single-bit error injected into
+# sample 6-byte frames must be detected.
+#
+#   python3 test_crc8.py [main.c]           -> exit status 0 if all checks pass
+
+import os
+import random
+import re
+import sys
+
+POLY = 0x31
+INIT = 0xFF
+NB_FRAMES = 1000
+
+
+def crc8_bitwise(data):
+    crc = INIT
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ POLY) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def crc8_table(tab, data):
+    """Same loop as aht20_crc8() in main.c."""
+    crc = INIT
+    for byte in data:
+        crc = tab[crc ^ byte]
+    return crc
+
+
+def load_table(path):
+    src = open(path).read()
+    body = re.search(r"crc8_table\[256\]\s*PROGMEM\s*=\s*\{(.*?)\};", src, re.S)
+    if not body:
+        raise ValueError("crc8_table not found in %s" % path)
+    return [int(v, 16) for v in re.findall(r"0x[0-9A-Fa-f]{2}", body.group(1))]
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else \
+        os.path.join(os.path.dirname(os.path.abspath(__file__)), "main.c")
+    tab = load_table(path)
+    errors = 0
+    if len(tab) != 256:
+        sys.stderr.write("crc8_table : %d entries\n" % len(tab))
+        return 1
+    for n in range(256):
+        if tab[n] != crc8_bitwise([n ^ INIT]):
+            sys.stderr.write("crc8_table[0x%02X] = 0x%02X, expected 0x%02X\n"
+                             % (n, tab[n], crc8_bitwise([n ^ INIT])))
+            errors += 1
+
+    # Status byte + 5 data bytes : one fixed frame, then random ones
+    rng = random.Random(42)
+    frames = [[0x1C, 0x6B, 0x3F, 0x25, 0xA6, 0x1B]]
+    frames += [[rng.randrange(256) for _ in range(6)] for _ in range(NB_FRAMES)]
+    missed = 0
+    for frame in frames:
+        crc = crc8_table(tab, frame)
+        if crc != crc8_bitwise(frame):
+            errors += 1
+        wire = frame + [crc]                        # The CRC byte can be hit too
+        for bit in range(len(wire) * 8):
+            bad = list(wire)
+            bad[bit // 8] ^= 1 << (bit % 8)
+            if crc8_table(tab, bad[:6]) == bad[6]:
+                missed += 1
+    sys.stderr.write("%d table mismatches, %d frames, %d single-bit errors missed\n"
+                     % (errors, len(frames), missed))
+    return 0 if errors == 0 and missed == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
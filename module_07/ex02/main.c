@@ -1,12 +1,28 @@
 #include <avr/io.h>
 #include <avr/eeprom.h>
+#include <avr/interrupt.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))     // Round to nearest int
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
 
 #define RED             "\e[1;31m"
 #define GREEN           "\e[1;32m"
@@ -22,26 +38,208 @@
 #define NO_SPACE    "No space left"
 #define EXISTS      "Already exists"
 
+// PROFILE 1 : Timer1 counts CPU cycles, PROF_BEGIN / PROF_END time the regions below and the
+// STATS command prints count / min / avg / max. PROFILE 0 : no timer, no command, no code.
+#define PROFILE     0
+#define STACK_CANARY 0xC5                   // Paint byte of the free RAM
+
+#define ARG_MAX     32                      // Key & value length limit
+
+typedef struct {
+    const char *ptr;                        // Into buf
+    uint8_t len;
+} token_t;
+
 char buf[100];
-char cmd[100];
-char key[100];
-char value[100];
+token_t cmd;
+token_t key;
+token_t value;
+uint8_t cmd_index = 0;
 uint16_t address = 0;
 uint8_t data = 0;
 volatile uint8_t i = 0;
 uint8_t bad_input = 0;
 
-const char *cmds[5] = {
+const char *cmds[] = {
     "READ",
     "WRITE",
     "FORGET",
-    "PRINT"
+    "PRINT",
+    "MEM",
+    "BAUD",
+#if PROFILE
+    "STATS",
+#endif
 };
+#define NB_CMDS (sizeof(cmds) / sizeof(cmds[0]))
+
+const uint8_t cmd_args[] = {                // Quoted arguments expected, same order as cmds
+    1,
+    2,
+    1,
+    0,
+    0,
+    1,
+#if PROFILE
+    0,
+#endif
+};
+
+uint8_t token_is(token_t tok, const char *str) {
+    return (strncmp(tok.ptr, str, tok.len) == 0 && str[tok.len] == '\0');
+}
+
+// **************************************************************** PROFILER */
+#if PROFILE
+typedef enum {
+    PROF_EEPROM_READ,
+    PROF_EEPROM_WRITE,
+    PROF_PARSE,
+    PROF_COMMAND,
+    PROF_UART_TX,
+    PROF_COUNT
+} prof_id_t;
+
+const char *prof_names[PROF_COUNT] = {
+    "EEPROM_read ",
+    "EEPROM_write",
+    "parse       ",
+    "command     ",
+    "uart_tx     "
+};
+
+typedef struct {
+    uint16_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t total;                         // Wraps after ~268s of accumulated time
+} prof_stat_t;
+
+prof_stat_t prof_stats[PROF_COUNT];
+volatile uint16_t prof_ovf = 0;
+uint16_t prof_overhead = 0;                 // Cycles of an empty BEGIN / END pair
+uint16_t prof_nest_cost = 0;                // Cycles a nested pair costs its parent outside its window
+uint32_t prof_child = 0;                    // Cycles of the regions nested in the open one
+
+ISR(TIMER1_OVF_vect) {                      // Every 65536 cycles : 32-bit count
+    prof_ovf++;
+}
+
+uint32_t prof_cycles(void) {
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t count = TCNT1;
+    uint16_t ovf = prof_ovf;
+    if ((TIFR1 & (1 << TOV1)) && count < 0x8000)
+        ovf++;                              // Wrapped, overflow not counted yet
+    SREG = sreg;
+    return (((uint32_t)ovf << 16) | count);
+}
+
+uint32_t prof_enter(void) {                 // Opens a region : returns the parent's child count
+    uint32_t outer = prof_child;
+    prof_child = 0;
+    return (outer);
+}
+
+// Regions nest (command > uart_tx, EEPROM_*) : each one records its self time, without its
+// children & their bookkeeping, then hands its whole cost to the parent through prof_child.
+void prof_record(prof_id_t id, uint32_t start, uint32_t outer) {
+    prof_stat_t *st = &prof_stats[id];
+    uint32_t cycles = prof_cycles() - start;
+    uint32_t spent = prof_overhead + prof_child;
+    cycles = (cycles > spent) ? cycles - spent : 0;
+    if (st->count == 0 || cycles < st->min)
+        st->min = cycles;
+    if (cycles > st->max)
+        st->max = cycles;
+    st->total += cycles;
+    st->count++;
+    prof_child = outer + (prof_cycles() - start) + prof_nest_cost;
+}
+
+#define PROF_BEGIN(id)  uint32_t prof_outer_##id = prof_enter(); \
+                        uint32_t prof_start_##id = prof_cycles()
+#define PROF_END(id)    prof_record(id, prof_start_##id, prof_outer_##id)
+
+void prof_init(void) {                      // Both costs are measured with the macros themselves
+    TCCR1A = 0;                             // Normal mode, free running
+    TCCR1B = (1 << CS10);                   // No prescaler : 1 count = 1 cycle
+    TIMSK1 = (1 << TOIE1);
+    sei();
+    {
+        PROF_BEGIN(PROF_PARSE);
+        PROF_END(PROF_PARSE);
+    }
+    prof_overhead = prof_stats[PROF_PARSE].max;
+    memset(prof_stats, 0, sizeof(prof_stats));
+    {
+        PROF_BEGIN(PROF_PARSE);
+        PROF_BEGIN(PROF_COMMAND);
+        PROF_END(PROF_COMMAND);
+        PROF_END(PROF_PARSE);
+    }
+    prof_nest_cost = prof_stats[PROF_PARSE].max;    // Parent self time left by an empty child
+    memset(prof_stats, 0, sizeof(prof_stats));
+    prof_child = 0;
+}
+#else
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+#endif
+
+// ********************************************************************* RAM */
+// 2KB : .data + .bss from RAMSTART to _end, the stack grows down from RAMEND (no heap).
+// .init1 paints _end -> RAMEND with STACK_CANARY before the stack is used : the lowest byte
+// still painted gives the stack high-water mark. MEM prints it with the peak use of the
+// line buffer, tracked below.
+extern uint8_t _end;
+extern uint8_t __stack;
+
+void stack_paint(void) __attribute__((naked, used, section(".init1")));
+void stack_paint(void) {                    // No C : r1 & SP are not set up yet
+    __asm__ __volatile__ (
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        :: "M" (STACK_CANARY)
+    );
+}
+
+uint16_t stack_untouched(void) {            // Bytes above _end never reached by the stack
+    const uint8_t *p = &_end;
+    while (p <= &__stack && *p == STACK_CANARY)
+        p++;
+    return (p - &_end);
+}
+
+typedef struct {
+    const char *name;
+    uint8_t size;
+    uint8_t peak;                           // Longest content seen, '\0' excluded
+} buf_stat_t;
+
+buf_stat_t buf_stats[] = {
+    {"buf  ", sizeof(buf), 0},
+};
+
+void buf_track(uint8_t index, uint8_t len) {
+    if (len > buf_stats[index].peak)
+        buf_stats[index].peak = len;
+}
 
 // ************************************************************** UART SETUP */
 void uart_init() {
     UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)MYUBRR;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
     UCSR0B = (1 << RXEN0) | (1 << TXEN0);   // Enable receiver & transmitter
     UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // Set frame format to 8N1 (8-bit frame, 1 stop bit, no parity)
 }
@@ -53,9 +251,12 @@ char uart_rx(void) {
 }
 
 void uart_tx(const char c) {
+    PROF_BEGIN(PROF_UART_TX);
     while (!(UCSR0A & (1 << UDRE0)))        // Wait for empty transmit buffer (if 0, buffer = full)
         ;
+    UCSR0A |= (1 << TXC0);                  // Clear Transmit Complete, set again once c is out
     UDR0 = c;                               // Put data into buffer, sends data
+    PROF_END(PROF_UART_TX);
 }
 
 void uart_printstr(const char *str) {
@@ -63,22 +264,47 @@ void uart_printstr(const char *str) {
         uart_tx(*str++);
 }
 
+// Runtime rates : 250k, 500k & 1M are exact at 16MHz in normal mode (UBRR 3, 1, 0)
+const uint32_t bauds[] = {UART_BAUDRATE, 250000, 500000, 1000000};
+
+void uart_set_baud(uint32_t baud) {         // TXC0 : the last character has left at the old rate
+    while (!(UCSR0A & (1 << TXC0)))
+        ;
+    if (baud == UART_BAUDRATE) {
+        UBRR0 = MYUBRR;
+        UCSR0A = (UART_U2X << U2X0);
+    } else {
+        UBRR0 = F_CPU / (16UL * baud) - 1;
+        UCSR0A = 0;
+    }
+}
+
 // ************************************************************ EEPROM SETUP */
 unsigned char EEPROM_read(uint16_t address) {
+    PROF_BEGIN(PROF_EEPROM_READ);
     while (EECR & (1 << EEPE))  // Wait for completion of previous write
         ;
     EEAR = address;             // Set up address register
     EECR |= (1 << EERE);        // Start eeprom read by writing EERE
+    PROF_END(PROF_EEPROM_READ);
     return (EEDR);              // Return data from Data Register
 }
 
 void EEPROM_write(uint16_t address, unsigned char data) {
+    PROF_BEGIN(PROF_EEPROM_WRITE);
     while (EECR & (1 << EEPE))  // Wait for completion of previous write
         ;
     EEAR = address;             // Set up address register
     EEDR = data;                // Load data to register
+#if PROFILE
+    cli();                      // EEMPE -> EEPE must be within 4 cycles (Timer1 ISR active)
+#endif
     EECR |= (1 << EEMPE);       // Write logical 1 to eempe
     EECR |= (1 << EEPE);        // Start eeprom write by setting EEPE
+#if PROFILE
+    sei();
+#endif
+    PROF_END(PROF_EEPROM_WRITE);
 }
 
 // ********************************************************** DISPLAY EEPROM */
@@ -147,7 +373,7 @@ void print_response(char *color, char *str) {
 
 // **************************** READ */
 uint8_t check_key(uint16_t *i) {
-    char key_tmp[33];
+    char key_tmp[ARG_MAX + 1];
     uint16_t j = 0;
     uint8_t byte = EEPROM_read(*i + j);
     while (byte != MAGIC_VAL) {
@@ -156,7 +382,7 @@ uint8_t check_key(uint16_t *i) {
         byte = EEPROM_read(*i + j);
     }
     key_tmp[j] = '\0';
-    if (strcmp(key, key_tmp) == 0) {
+    if (token_is(key, key_tmp)) {
         j++;
         byte = EEPROM_read(*i + j);
         uart_printstr(GREEN);
@@ -188,7 +414,7 @@ void handle_READ() {
 
 // *************************** WRITE */
 uint8_t check_space(uint16_t *i) {
-    uint8_t space_needed = strlen(key) + strlen(value) + 3;
+    uint8_t space_needed = key.len + value.len + 3;
     uint8_t magic = 0;
     for (uint8_t j = 0; j < space_needed; j++) {
         magic = EEPROM_read(*i + j);
@@ -203,12 +429,12 @@ uint8_t check_space(uint16_t *i) {
 void write_pair(uint16_t i) {
     uint8_t address = i;
     EEPROM_write(i++, MAGIC_OCCUPIED);
-    for (uint8_t j = 0; j < strlen(key); j++) {
-        EEPROM_write(i++, key[j]);
+    for (uint8_t j = 0; j < key.len; j++) {
+        EEPROM_write(i++, key.ptr[j]);
     }
     EEPROM_write(i++, MAGIC_VAL);
-    for (uint8_t j = 0; j < strlen(value); j++) {
-        EEPROM_write(i++, value[j]);
+    for (uint8_t j = 0; j < value.len; j++) {
+        EEPROM_write(i++, value.ptr[j]);
     }
     EEPROM_write(i++, MAGIC_END);
     uart_printstr(GREEN);
@@ -223,7 +449,7 @@ int16_t check_existing_pair() {
     for (uint16_t i = 0; i < 1024; i++) {
         byte = EEPROM_read(i);
         if (byte == MAGIC_OCCUPIED) {
-            char key_tmp[33];
+            char key_tmp[ARG_MAX + 1];
             uint8_t j = 0;
             int16_t address = i;
             i++;
@@ -235,7 +461,7 @@ int16_t check_existing_pair() {
                 byte = EEPROM_read(i);
             }
             key_tmp[j] = '\0';
-            if (strcmp(key, key_tmp) == 0)
+            if (token_is(key, key_tmp))
                 return (address);
         }
     }
@@ -280,92 +506,137 @@ void handle_PRINT() {
     display_status();
 }
 
+void print_nbr(uint32_t n) {
+    char nbr[11];
+    ultoa(n, nbr, 10);
+    uart_printstr(nbr);
+}
+
+void handle_MEM() {
+    uint16_t statics = &_end - (uint8_t *)RAMSTART;
+    uint16_t untouched = stack_untouched();
+    uart_printstr("\r\nstatic data  ");
+    print_nbr(statics);
+    uart_printstr("\r\nstack peak   ");
+    print_nbr(RAMEND + 1 - RAMSTART - statics - untouched);
+    uart_printstr("\r\nnever used   ");
+    print_nbr(untouched);
+    uart_printstr("\r\n");
+    for (uint8_t j = 0; j < sizeof(buf_stats) / sizeof(buf_stats[0]); j++) {
+        uart_printstr(buf_stats[j].name);
+        uart_printstr("        ");
+        print_nbr(buf_stats[j].peak);
+        uart_tx('/');
+        print_nbr(buf_stats[j].size - 1);
+        uart_printstr("\r\n");
+    }
+}
+
+void handle_BAUD() {                        // Reply at the old rate, prompt at the new one
+    uint32_t baud = strtoul(key.ptr, NULL, 10);     // Stops on the closing quote
+    for (uint8_t j = 0; j < sizeof(bauds) / sizeof(bauds[0]); j++) {
+        if (baud == bauds[j]) {
+            print_response(GREEN, "Switch the terminal");
+            uart_set_baud(baud);
+            return ;
+        }
+    }
+    print_response(RED, "115200 | 250000 | 500000 | 1000000");
+}
+
+#if PROFILE
+void handle_STATS() {                       // Cycles per region, then reset
+    prof_stat_t stats[PROF_COUNT];
+    memcpy(stats, prof_stats, sizeof(stats));   // Printing below is profiled too
+    memset(prof_stats, 0, sizeof(prof_stats));
+    uart_printstr("\r\nregion        count  min  avg  max (cycles)\r\n");
+    for (uint8_t j = 0; j < PROF_COUNT; j++) {
+        uart_printstr(prof_names[j]);
+        uart_printstr("  ");
+        print_nbr(stats[j].count);
+        uart_printstr("  ");
+        print_nbr(stats[j].min);
+        uart_printstr("  ");
+        print_nbr(stats[j].count ? stats[j].total / stats[j].count : 0);
+        uart_printstr("  ");
+        print_nbr(stats[j].max);
+        uart_printstr("\r\n");
+    }
+}
+#endif
+
 void (*cmd_functions[])() = {
     handle_READ,
     handle_WRITE,
     handle_FORGET,
-    handle_PRINT
+    handle_PRINT,
+    handle_MEM,
+    handle_BAUD,
+#if PROFILE
+    handle_STATS,
+#endif
 };
 
-void handle_cmd() {
-    for (uint8_t i = 0; i < 4; i++) {
-        if (strcmp(cmds[i], cmd) == 0) {
-            cmd_functions[i]();
-            return ;
-        }
-    }
+void handle_cmd() {                         // cmd_index is set by parse_input
+    PROF_BEGIN(PROF_COMMAND);
+    cmd_functions[cmd_index]();
+    PROF_END(PROF_COMMAND);
 }
 
 // **************************************************************** PARSING  */
-void check_arg_len() {
-    if (strcmp(cmd, "PRINT") != 0
-        && !(strlen(key) > 0 && strlen(key) <= 32))
-        bad_input = 1;
-    if (strcmp(cmd, "WRITE") == 0
-        && !(strlen(value) > 0 && strlen(value) <= 32))
-        bad_input = 1;
-}
-
-uint8_t quote_open = 0;
-void extract_arg(char *dest, uint8_t *j) {
-    while (buf[*j] && buf[*j] == ' ')
-        (*j)++;
-    while (buf[*j] && buf[*j] != '\"') 
-        (*j)++;
-    if (buf[*j] == '\"') {
-        quote_open = 1;
-        (*j)++;
-    }
-    while (buf[*j] && buf[*j] != '\"') {
-        *dest = buf[*j];
-        (*j)++;
-        dest++;
-    }
-    *dest = '\0';
-    if (buf[*j] == '\"') {
-        quote_open = 0;
+// <CMD> ["<key>" ["<value>"]] : one pass over buf, the tokens are slices of it (not terminated).
+// The argument count of the command is checked afterwards, key & value are 1..ARG_MAX chars.
+uint8_t next_arg(uint8_t *j, token_t *arg) {
+    while (buf[*j] == ' ')
         (*j)++;
+    arg->len = 0;
+    if (buf[*j] == '\0')
+        return (0);
+    if (buf[*j] != '\"') {                  // Unquoted argument
+        bad_input = 1;
+        return (0);
     }
-}
-
-void extract_cmd(char *dest, uint8_t *j) {
-    while (buf[*j] && buf[*j] != ' ') {
-        *dest = buf[*j];
+    arg->ptr = &buf[++(*j)];
+    while (buf[*j] && buf[*j] != '\"')
         (*j)++;
-        dest++;
+    if (buf[*j] != '\"') {                  // Quote left open
+        bad_input = 1;
+        return (0);
     }
-    *dest = '\0';
+    arg->len = &buf[(*j)++] - arg->ptr;
+    if (arg->len == 0 || arg->len > ARG_MAX)
+        bad_input = 1;
+    return (1);
 }
 
-uint8_t tokenize() {
+void parse_input() {
+    PROF_BEGIN(PROF_PARSE);
     uint8_t j = 0;
-    if (i == 0)
+    uint8_t nb_args = 0;
+    cmd.ptr = buf;
+    while (buf[j] && buf[j] != ' ')
+        j++;
+    cmd.len = j;
+    value.len = 0;
+    nb_args += next_arg(&j, &key);
+    if (nb_args == 1)
+        nb_args += next_arg(&j, &value);
+    while (buf[j] == ' ')
+        j++;
+    if (buf[j] != '\0')                     // Third argument or text after a quote
         bad_input = 1;
-    extract_cmd(cmd, &j);
-    extract_arg(key, &j);
-    extract_arg(value, &j);
-    if (quote_open || cmd[0] == '\0')
+    for (cmd_index = 0; cmd_index < NB_CMDS && !token_is(cmd, cmds[cmd_index]); cmd_index++)
+        ;
+    if (cmd_index == NB_CMDS || nb_args != cmd_args[cmd_index])
         bad_input = 1;
-    return (0);
-}
-
-void parse_input() {
-    tokenize();
-    if (bad_input == 1)
-        return ;
-    for (uint8_t i = 0; i < 4; i++) {
-        if (strcmp(cmds[i], cmd) == 0) {
-            check_arg_len();
-            return ;
-        }
-    }
-    bad_input = 1;
+    PROF_END(PROF_PARSE);
 }
 
 // ********************************************************* INPUT HANDLING  */
 void handle_enter()
 {
     buf[i] = '\0';
+    buf_track(0, i);
     parse_input();
     if (bad_input)
         print_response(RED, BAD_INPUT);
@@ -390,7 +661,7 @@ void handle_input() {
         handle_backspace();
     else if (c == '\n' || c == '\r')        // Handle enter
         handle_enter();
-    else if (i < 100) {                     // Collect input if in bounds
+    else if (i < sizeof(buf) - 1) {         // Collect input if in bounds, keep room for '\0'
         buf[i] = c;
         uart_tx(c);
         i++;
@@ -398,6 +669,9 @@ void handle_input() {
 }
 
 int main() {
+#if PROFILE
+    prof_init();
+#endif
     uart_init();
     display_status();
     uart_printstr("EEPROM> ");
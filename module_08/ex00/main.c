@@ -6,16 +6,30 @@
 #define SS      PB2  // Slave Select (SK9822 uses no SS, but keep low)
 #define MOSI    PB3  // SPI MOSI (Data Out)
 #define SCK     PB5  // SPI Clock
+#define SPI_DIV 2    // SPI clock = F_CPU / 2 = 8MHz (SK9822 accepts up to 30MHz)
 #define START   0x00 // Start frame
 #define END     0xFF // End frame
 
 // *************************************************************** SPI SETUP */
+void SPI_set_clock(uint8_t div) {          // SPI clock = F_CPU / div, div = 2, 4, 8 ... 128
+    uint8_t spr = 0;                        // SPR1:0 = 0 -> /4, 1 -> /16, 2 -> /64, 3 -> /128
+    uint8_t x2 = (div == 2 || div == 8 || div == 32);
+    if (x2)
+        div <<= 1;                          // SPI2X doubles the rate of the next slower setting
+    while (div > 4 && spr < 3) {
+        div >>= 2;
+        spr++;
+    }
+    SPCR = (SPCR & ~((1 << SPR1) | (1 << SPR0))) | spr;
+    SPSR = x2 ? (1 << SPI2X) : 0;
+}
+
 void SPI_master_init(void) {
     DDR_SPI = (1 << MOSI) | (1 << SCK)      // Set MOSI and SCK output, 
         | (1 << SS);                        // SS output - deactivate slave
     PORTB &= ~(1 << PB2);                   // Set SS output
-    SPCR = (1 << SPE)| (1 << MSTR)          // Enable SPI & Master
-        | (1 << SPR0);                      // Set clock rate f_osc/16
+    SPCR = (1 << SPE)| (1 << MSTR);         // Enable SPI & Master
+    SPI_set_clock(SPI_DIV);
 }
 
 void SPI_master_transmit(char data) {
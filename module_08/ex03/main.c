@@ -6,8 +6,10 @@
 #define SS      PB2             // Slave Select (SK9822 uses no SS, but keep low)
 #define MOSI    PB3             // SPI MOSI (Data Out)
 #define SCK     PB5             // SPI Clock
+#define SPI_DIV 2               // SPI clock = F_CPU / 2 = 8MHz (SK9822 accepts up to 30MHz)
 #define START   (uint8_t)0x00   // Start frame
 #define END     (uint8_t)0xFF   // End frame
+#define HYSTERESIS 3            // Pot noise around a threshold does not re-send the frame
 
 const uint8_t colors[7][3] = {
     {255, 0, 0},
@@ -34,13 +36,62 @@ uint8_t adc_read(void) {
     return (ADCH);                          // Read 8-bit ADC result
 }
 
+// ************************************************************** ADC EVENTS */
+// Consumers only run on an event instead of on every sample :
+// - ADC_EV_CHANGE : value moved by at least `delta` since the last report (or hit 0 / 255)
+// - ADC_EV_LEVEL  : value crossed one of `thresholds`, with `hysteresis` on the way down
+#define ADC_EV_CHANGE   0x01
+#define ADC_EV_LEVEL    0x02
+
+typedef struct {
+    uint8_t value;                          // Last reported value
+    uint8_t delta;
+    uint8_t level;                          // Number of thresholds reached
+    uint8_t hysteresis;
+    uint8_t nb_thresholds;
+    const uint8_t *thresholds;              // Ascending
+} adc_event_t;
+
+uint8_t adc_event_update(adc_event_t *ev, uint8_t sample) {
+    uint8_t events = 0;
+    uint8_t diff = (sample > ev->value) ? sample - ev->value : ev->value - sample;
+
+    if (diff >= ev->delta || (diff && (sample == 0 || sample == 255))) {
+        ev->value = sample;
+        events |= ADC_EV_CHANGE;
+    }
+    uint8_t level = ev->level;
+    while (level < ev->nb_thresholds && sample >= ev->thresholds[level])
+        level++;
+    while (level > 0 && sample + ev->hysteresis < ev->thresholds[level - 1])
+        level--;
+    if (level != ev->level) {
+        ev->level = level;
+        events |= ADC_EV_LEVEL;
+    }
+    return (events);
+}
+
 // *************************************************************** SPI SETUP */
+void SPI_set_clock(uint8_t div) {          // SPI clock = F_CPU / div, div = 2, 4, 8 ... 128
+    uint8_t spr = 0;                        // SPR1:0 = 0 -> /4, 1 -> /16, 2 -> /64, 3 -> /128
+    uint8_t x2 = (div == 2 || div == 8 || div == 32);
+    if (x2)
+        div <<= 1;                          // SPI2X doubles the rate of the next slower setting
+    while (div > 4 && spr < 3) {
+        div >>= 2;
+        spr++;
+    }
+    SPCR = (SPCR & ~((1 << SPR1) | (1 << SPR0))) | spr;
+    SPSR = x2 ? (1 << SPI2X) : 0;
+}
+
 void SPI_master_init(void) {
     DDR_SPI = (1 << MOSI) | (1 << SCK)      // Set MOSI and SCK output, 
         | (1 << SS);                        // SS output - deactivate slave
     PORTB &= ~(1 << PB2);                   // Set SS output
-    SPCR = (1 << SPE)| (1 << MSTR)          // Enable SPI & Master
-        | (1 << SPR0);                      // Set clock rate f_osc/16
+    SPCR = (1 << SPE)| (1 << MSTR);         // Enable SPI & Master
+    SPI_set_clock(SPI_DIV);
 }
 
 void SPI_master_transmit(char data) {
@@ -61,35 +112,36 @@ void set_color(uint8_t brightness, uint8_t red, uint8_t green, uint8_t blue) {
     SPI_master_transmit(red);
 }
 
-void toggle_leds(uint8_t value) {
-    if (value < 85) {
-        set_color(0, 0, 0, 0);
-        set_color(0, 0, 0, 0);
-        set_color(0, 0, 0, 0);
-    }
-    else if (value < 170) {
-        set_color(10, colors[6][0], colors[6][1], colors[6][2]);
-        set_color(0, 0, 0, 0);
-        set_color(0, 0, 0, 0);
-    } else if (value < 255) {
-        set_color(10, colors[6][0], colors[6][1], colors[6][2]);
-        set_color(10, colors[6][0], colors[6][1], colors[6][2]);
-        set_color(0, 0, 0, 0);
-    } else if (value == 255) {
-        set_color(10, colors[6][0], colors[6][1], colors[6][2]);
-        set_color(10, colors[6][0], colors[6][1], colors[6][2]);
-        set_color(10, colors[6][0], colors[6][1], colors[6][2]);
+const uint8_t thresholds[] = {85, 170, 255};
+
+void toggle_leds(uint8_t level) {           // Number of thresholds reached = LEDs on
+    for (uint8_t led = 0; led < 3; led++) {
+        if (led < level)
+            set_color(10, colors[6][0], colors[6][1], colors[6][2]);
+        else
+            set_color(0, 0, 0, 0);
     }
 }
 
 int main() {
     SPI_master_init();
     adc_init();
+    adc_event_t pot = {
+        .delta = 255,                       // Only levels matter here
+        .hysteresis = HYSTERESIS,
+        .nb_thresholds = sizeof(thresholds),
+        .thresholds = thresholds
+    };
+    adc_event_update(&pot, adc_read());
+    set_transmit(START);                    // Initial frame, then only when the level changes
+    toggle_leds(pot.level);
+    set_transmit(END);
     while (1) {
-        uint8_t value = adc_read();
-        set_transmit(START);
-        toggle_leds(value);
-        set_transmit(END);
+        if (adc_event_update(&pot, adc_read()) & ADC_EV_LEVEL) {
+            set_transmit(START);
+            toggle_leds(pot.level);
+            set_transmit(END);
+        }
     }
     return (0);
 }
\ No newline at end of file
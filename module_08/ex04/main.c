@@ -1,6 +1,7 @@
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -8,37 +9,47 @@
 #define GREEN   "\e[1;32m"
 #define RESET   "\033[0m"
 #define BAD_INPUT   "Bad input - invalid format"
+#define SAVED       "Animation saved"
 
 #define DDR_SPI DDRB
 #define SS      PB2             // Slave Select (SK9822 uses no SS, but keep low)
 #define MOSI    PB3             // SPI MOSI (Data Out)
 #define SCK     PB5             // SPI Clock
+#define SPI_DIV 16              // SPI clock = F_CPU / 16 : 1 byte = 128 cycles, room for SPI_STC_vect
 #define START   (uint8_t)0x00   // Start frame
-#define END     (uint8_t)0xFF   // End frame
 
 #define TOP_TIMER0 (F_CPU / 1024UL / 100)     // 10ms interrupt period = 156.25
 #define UART_BAUDRATE 115200
-#define round(x) (x >= 0 ? (int)(x + 0.5) : (int)(x - 0.5))
-#define MYUBRR round((F_CPU / (16.0 * UART_BAUDRATE)) - 1.0)    // Round to 8
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
 
 #define NEXT_LINE "\033[1E"
 #define CURSOR_LEFT "\033[D"
 
 volatile uint8_t i = 0;
 volatile uint8_t bad_input = 0;
-uint8_t rainbow = 0;
-char input[13];
-uint8_t color[3];
-uint8_t led = 0;
-uint8_t pos = 0;
-static uint8_t prev_color6[3] = {0, 0, 0};
-static uint8_t prev_color7[3] = {0, 0, 0};
-static uint8_t prev_color8[3] = {0, 0, 0};
+char input[64];                             // One line, several LED groups
 
 // ************************************************************** UART SETUP */
 void uart_init() {
     UBRR0H = (unsigned char)(MYUBRR >> 8);    // Set baud rate in 16-bit USART Baud Rate Register
     UBRR0L = (unsigned char)MYUBRR;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
     
     UCSR0B = (1 << RXEN0) | (1 << TXEN0)    // Enable receiver & transmitter
         | (1 << RXCIE0);             
@@ -62,94 +73,370 @@ void uart_printstr(const char *str) {
         uart_tx(*str++);
 }
 
+// ******************************************************************** IDLE */
+// Animation ticks (Timer0), SPI frames & commands (USART RX) all run from interrupts : main
+// sleeps in Idle mode in between (CPU & flash clocks off). TWI, Timer1, Timer2 & ADC : PRR.
+// SLEEP_STATS 1 : each sleep is timestamped from the Timer0 tick (64us counts) & closed by
+// SLEEP_WAKE() in the animation & USART ISRs, which can draw a whole frame, or when idle()
+// returns (SPI_STC_vect, a few us per byte, counts as asleep). "asleep N%" every STATS_TICKS.
+#define SLEEP_STATS     0
+#define STATS_TICKS     100                 // Timer0 ticks per report (~1s)
+
+void power_init(void) {
+    ADCSRA &= ~(1 << ADEN);                 // ADC off before its clock is cut
+    PRR = (1 << PRTWI) | (1 << PRTIM2) | (1 << PRTIM1) | (1 << PRADC);
+}
+
+#if SLEEP_STATS
+volatile uint32_t stats_tick = 0;           // Timer0 ticks, from TIMER0_COMPA_vect
+volatile uint8_t sleeping = 0;
+volatile uint32_t sleep_counts = 0;         // Time asleep in the current report period
+uint32_t sleep_start = 0;
+uint32_t stats_start = 0;
+
+uint32_t stats_now(void) {                  // Timer0 counts, interrupts disabled
+    uint8_t count = TCNT0;
+    uint32_t tick = stats_tick;
+    if ((TIFR0 & (1 << OCF0A)) && count < TOP_TIMER0)
+        tick++;                             // Compare match pending : not counted yet
+    return (tick * (TOP_TIMER0 + 1) + count);
+}
+
+void sleep_wake(void) {
+    if (sleeping) {
+        sleep_counts += stats_now() - sleep_start;
+        sleeping = 0;
+    }
+}
+#define SLEEP_WAKE() sleep_wake()
+
+void stats_report(void) {
+    cli();
+    sleep_wake();
+    uint32_t total = stats_now() - stats_start;
+    uint32_t asleep = sleep_counts;
+    if (total >= STATS_TICKS * (TOP_TIMER0 + 1)) {
+        stats_start += total;
+        sleep_counts = 0;
+    }
+    sei();
+    if (total < STATS_TICKS * (TOP_TIMER0 + 1))
+        return ;
+    char pct[4];
+    utoa(asleep * 100 / total, pct, 10);
+    uart_printstr("asleep ");
+    uart_printstr(pct);
+    uart_printstr("%" NEXT_LINE);
+}
+#else
+#define SLEEP_WAKE()
+#endif
+
+void idle(void) {                           // Returns after the next interrupt
+    cli();
+#if SLEEP_STATS
+    sleep_start = stats_now();
+    sleeping = 1;
+#endif
+    SMCR = (1 << SE);                       // SM2:0 = 000 : Idle mode
+    sei();                                  // sei always executes the next instruction first :
+    __asm__ __volatile__ ("sleep");         // no interrupt can slip in before the sleep
+    SMCR = 0;
+#if SLEEP_STATS
+    stats_report();
+#endif
+}
+
 // *************************************************************** SPI SETUP */
+void SPI_set_clock(uint8_t div) {          // SPI clock = F_CPU / div, div = 2, 4, 8 ... 128
+    uint8_t spr = 0;                        // SPR1:0 = 0 -> /4, 1 -> /16, 2 -> /64, 3 -> /128
+    uint8_t x2 = (div == 2 || div == 8 || div == 32);
+    if (x2)
+        div <<= 1;                          // SPI2X doubles the rate of the next slower setting
+    while (div > 4 && spr < 3) {
+        div >>= 2;
+        spr++;
+    }
+    SPCR = (SPCR & ~((1 << SPR1) | (1 << SPR0))) | spr;
+    SPSR = x2 ? (1 << SPI2X) : 0;
+}
+
 void SPI_master_init(void) {
     DDR_SPI = (1 << MOSI) | (1 << SCK)      // Set MOSI and SCK output, 
         | (1 << SS);                        // SS output - deactivate slave
     PORTB &= ~(1 << PB2);                   // Set SS output
     SPCR = (1 << SPE)| (1 << MSTR)          // Enable SPI & Master
-        | (1 << SPR0);                      // Set clock rate f_osc/16
+        | (1 << SPIE);                      // Enable SPI transfer complete interrupt
+    SPI_set_clock(SPI_DIV);
 }
 
-void SPI_master_transmit(char data) {
-    SPDR = data;                            // Start transmission
-    while(!(SPSR & (1 << SPIF)))            // Wait for transmission to complete
-        ;
+// *************************************************************** LED STRIP */
+// Frame buffer in wire format, 4 bytes per LED : 0xE0 | brightness, blue, green, red
+// show() = start frame | buffer | SK9822 reset frame | end frame (1 clock edge per 2 LEDs)
+#define LED_COUNT       3                   // 3 LEDs on the devkit, up to LED_MAX on a strip
+#define LED_MAX         128                 // strip + strip_tx = 8 bytes per LED : 1KB of SRAM
+#define LED_FIRST       6                   // Name of the first LED : D6 on the devkit, D0 on a strip
+#define LED_BRIGHTNESS  10                  // Default global brightness (0 - 31)
+#define LED_END_BYTES   ((LED_COUNT + 15) / 16)
+#define LED_DATA_START  4                   // Start frame length
+#define LED_DATA_END    (LED_DATA_START + LED_COUNT * 4)
+#define LED_FRAME_LEN   (LED_DATA_END + 4 + LED_END_BYTES)
+#if LED_COUNT > LED_MAX
+#error "LED_COUNT : strip & strip_tx would not fit in SRAM"
+#endif
+
+uint8_t strip[LED_COUNT][4];                // Drawn by the application
+uint8_t strip_tx[LED_COUNT][4];             // Snapshot being sent by SPI_STC_vect
+volatile uint8_t spi_busy = 0;
+volatile uint8_t spi_pending = 0;           // show() called during a transfer
+volatile uint8_t strip_ready = 1;           // No strip_set() since the last show() : safe to snapshot
+uint16_t spi_pos = 0;                       // Next byte of the frame, ISR only
+
+void strip_set(uint8_t n, uint8_t red, uint8_t green, uint8_t blue) {
+    strip_ready = 0;
+    strip[n][1] = blue;
+    strip[n][2] = green;
+    strip[n][3] = red;
+}
+
+void strip_set_brightness(uint8_t n, uint8_t brightness) {
+    strip_ready = 0;
+    strip[n][0] = 0xE0 | (brightness & 0x1F);
+}
+
+void strip_fill(uint8_t red, uint8_t green, uint8_t blue) {
+    for (uint8_t n = 0; n < LED_COUNT; n++)
+        strip_set(n, red, green, blue);
+}
+
+void strip_init(void) {
+    for (uint8_t n = 0; n < LED_COUNT; n++)
+        strip_set_brightness(n, LED_BRIGHTNESS);
+    strip_fill(0, 0, 0);
+}
+
+uint8_t strip_next_byte(void) {
+    uint16_t pos = spi_pos++;
+    if (pos >= LED_DATA_START && pos < LED_DATA_END)
+        return ((&strip_tx[0][0])[pos - LED_DATA_START]);
+    return (START);                         // Start, SK9822 reset & end frames are all zeros
+}
+
+// Snapshot in SPI_STC_vect : memcpy ~8 cycles per byte = 32 per LED, 6us with interrupts
+// off at 3 LEDs, 256us at LED_MAX (3 characters at 115200 baud : USART_RX_vect may overrun)
+void strip_start(void) {                    // Swap : snapshot the drawing, send it
+    memcpy(strip_tx, strip, sizeof(strip));
+    spi_pos = 0;
+    spi_pending = 0;
+    spi_busy = 1;
+    SPDR = strip_next_byte();               // The rest follows from SPI_STC_vect
+}
+
+ISR(SPI_STC_vect) {                         // One byte sent
+    if (spi_pos < LED_FRAME_LEN)
+        SPDR = strip_next_byte();
+    else if (spi_pending && strip_ready)    // Frame done & a newer complete one is waiting
+        strip_start();
+    else
+        spi_busy = 0;
 }
 
-void set_transmit(uint8_t frame) {
-    for (uint8_t i = 0; i < 4; i++)         // Send Start Frame (32 bits)
-        SPI_master_transmit(frame);         // Then send LED frame
+void strip_show(void) {                     // Returns immediately, the frame goes out in background
+    uint8_t sreg = SREG;
+    cli();
+    strip_ready = 1;
+    if (spi_busy)
+        spi_pending = 1;                    // Sent as soon as the current frame is complete,
+    else                                    // unless drawing has started again : next show()
+        strip_start();
+    SREG = sreg;
 }
 
-void set_color(uint8_t brightness, uint8_t red, uint8_t green, uint8_t blue) {
-    SPI_master_transmit(0xE0 | (brightness & 0x1F));
-    SPI_master_transmit(blue);
-    SPI_master_transmit(green);
-    SPI_master_transmit(red);
+// ******************************************************************* COLOR */
+// Tables from module_03/ex02/gen_color_tables.py, read from flash (3 cycles per LPM) :
+// - wheel()      : 3 table reads instead of compare + multiply branches
+// - color_gamma(): 3 table reads, applied last so fades look linear to the eye
+// module_08/spi_bench prints the cycle count of each conversion.
+typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} rgb_t;
+
+// Generated by module_03/ex02/gen_color_tables.py : gamma 2.8
+const uint8_t gamma8_table[256] PROGMEM = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+      5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+     10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+     17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+     25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+     37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+     51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+     69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+     90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+    115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+    144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+    177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+    215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255
+};
+
+const uint8_t wheel_table[256][3] PROGMEM = {
+    {255,   0,   0}, {252,   3,   0}, {249,   6,   0}, {246,   9,   0},
+    {243,  12,   0}, {240,  15,   0}, {237,  18,   0}, {234,  21,   0},
+    {231,  24,   0}, {228,  27,   0}, {225,  30,   0}, {222,  33,   0},
+    {219,  36,   0}, {216,  39,   0}, {213,  42,   0}, {210,  45,   0},
+    {207,  48,   0}, {204,  51,   0}, {201,  54,   0}, {198,  57,   0},
+    {195,  60,   0}, {192,  63,   0}, {189,  66,   0}, {186,  69,   0},
+    {183,  72,   0}, {180,  75,   0}, {177,  78,   0}, {174,  81,   0},
+    {171,  84,   0}, {168,  87,   0}, {165,  90,   0}, {162,  93,   0},
+    {159,  96,   0}, {156,  99,   0}, {153, 102,   0}, {150, 105,   0},
+    {147, 108,   0}, {144, 111,   0}, {141, 114,   0}, {138, 117,   0},
+    {135, 120,   0}, {132, 123,   0}, {129, 126,   0}, {126, 129,   0},
+    {123, 132,   0}, {120, 135,   0}, {117, 138,   0}, {114, 141,   0},
+    {111, 144,   0}, {108, 147,   0}, {105, 150,   0}, {102, 153,   0},
+    { 99, 156,   0}, { 96, 159,   0}, { 93, 162,   0}, { 90, 165,   0},
+    { 87, 168,   0}, { 84, 171,   0}, { 81, 174,   0}, { 78, 177,   0},
+    { 75, 180,   0}, { 72, 183,   0}, { 69, 186,   0}, { 66, 189,   0},
+    { 63, 192,   0}, { 60, 195,   0}, { 57, 198,   0}, { 54, 201,   0},
+    { 51, 204,   0}, { 48, 207,   0}, { 45, 210,   0}, { 42, 213,   0},
+    { 39, 216,   0}, { 36, 219,   0}, { 33, 222,   0}, { 30, 225,   0},
+    { 27, 228,   0}, { 24, 231,   0}, { 21, 234,   0}, { 18, 237,   0},
+    { 15, 240,   0}, { 12, 243,   0}, {  9, 246,   0}, {  6, 249,   0},
+    {  3, 252,   0}, {  0, 255,   0}, {  0, 252,   3}, {  0, 249,   6},
+    {  0, 246,   9}, {  0, 243,  12}, {  0, 240,  15}, {  0, 237,  18},
+    {  0, 234,  21}, {  0, 231,  24}, {  0, 228,  27}, {  0, 225,  30},
+    {  0, 222,  33}, {  0, 219,  36}, {  0, 216,  39}, {  0, 213,  42},
+    {  0, 210,  45}, {  0, 207,  48}, {  0, 204,  51}, {  0, 201,  54},
+    {  0, 198,  57}, {  0, 195,  60}, {  0, 192,  63}, {  0, 189,  66},
+    {  0, 186,  69}, {  0, 183,  72}, {  0, 180,  75}, {  0, 177,  78},
+    {  0, 174,  81}, {  0, 171,  84}, {  0, 168,  87}, {  0, 165,  90},
+    {  0, 162,  93}, {  0, 159,  96}, {  0, 156,  99}, {  0, 153, 102},
+    {  0, 150, 105}, {  0, 147, 108}, {  0, 144, 111}, {  0, 141, 114},
+    {  0, 138, 117}, {  0, 135, 120}, {  0, 132, 123}, {  0, 129, 126},
+    {  0, 126, 129}, {  0, 123, 132}, {  0, 120, 135}, {  0, 117, 138},
+    {  0, 114, 141}, {  0, 111, 144}, {  0, 108, 147}, {  0, 105, 150},
+    {  0, 102, 153}, {  0,  99, 156}, {  0,  96, 159}, {  0,  93, 162},
+    {  0,  90, 165}, {  0,  87, 168}, {  0,  84, 171}, {  0,  81, 174},
+    {  0,  78, 177}, {  0,  75, 180}, {  0,  72, 183}, {  0,  69, 186},
+    {  0,  66, 189}, {  0,  63, 192}, {  0,  60, 195}, {  0,  57, 198},
+    {  0,  54, 201}, {  0,  51, 204}, {  0,  48, 207}, {  0,  45, 210},
+    {  0,  42, 213}, {  0,  39, 216}, {  0,  36, 219}, {  0,  33, 222},
+    {  0,  30, 225}, {  0,  27, 228}, {  0,  24, 231}, {  0,  21, 234},
+    {  0,  18, 237}, {  0,  15, 240}, {  0,  12, 243}, {  0,   9, 246},
+    {  0,   6, 249}, {  0,   3, 252}, {  0,   0, 255}, {  3,   0, 252},
+    {  6,   0, 249}, {  9,   0, 246}, { 12,   0, 243}, { 15,   0, 240},
+    { 18,   0, 237}, { 21,   0, 234}, { 24,   0, 231}, { 27,   0, 228},
+    { 30,   0, 225}, { 33,   0, 222}, { 36,   0, 219}, { 39,   0, 216},
+    { 42,   0, 213}, { 45,   0, 210}, { 48,   0, 207}, { 51,   0, 204},
+    { 54,   0, 201}, { 57,   0, 198}, { 60,   0, 195}, { 63,   0, 192},
+    { 66,   0, 189}, { 69,   0, 186}, { 72,   0, 183}, { 75,   0, 180},
+    { 78,   0, 177}, { 81,   0, 174}, { 84,   0, 171}, { 87,   0, 168},
+    { 90,   0, 165}, { 93,   0, 162}, { 96,   0, 159}, { 99,   0, 156},
+    {102,   0, 153}, {105,   0, 150}, {108,   0, 147}, {111,   0, 144},
+    {114,   0, 141}, {117,   0, 138}, {120,   0, 135}, {123,   0, 132},
+    {126,   0, 129}, {129,   0, 126}, {132,   0, 123}, {135,   0, 120},
+    {138,   0, 117}, {141,   0, 114}, {144,   0, 111}, {147,   0, 108},
+    {150,   0, 105}, {153,   0, 102}, {156,   0,  99}, {159,   0,  96},
+    {162,   0,  93}, {165,   0,  90}, {168,   0,  87}, {171,   0,  84},
+    {174,   0,  81}, {177,   0,  78}, {180,   0,  75}, {183,   0,  72},
+    {186,   0,  69}, {189,   0,  66}, {192,   0,  63}, {195,   0,  60},
+    {198,   0,  57}, {201,   0,  54}, {204,   0,  51}, {207,   0,  48},
+    {210,   0,  45}, {213,   0,  42}, {216,   0,  39}, {219,   0,  36},
+    {222,   0,  33}, {225,   0,  30}, {228,   0,  27}, {231,   0,  24},
+    {234,   0,  21}, {237,   0,  18}, {240,   0,  15}, {243,   0,  12},
+    {246,   0,   9}, {249,   0,   6}, {252,   0,   3}, {255,   0,   0}
+};
+
+rgb_t wheel(uint8_t pos) {                  // Smooth red -> purple -> green -> red transition
+    const uint8_t *p = wheel_table[pos];
+    rgb_t c = {pgm_read_byte(p), pgm_read_byte(p + 1), pgm_read_byte(p + 2)};
+    return (c);
+}
+
+uint8_t gamma8(uint8_t value) {
+    return (pgm_read_byte(&gamma8_table[value]));
+}
+
+rgb_t color_gamma(rgb_t c) {
+    c.r = gamma8(c.r);
+    c.g = gamma8(c.g);
+    c.b = gamma8(c.b);
+    return (c);
 }
 
 // ********************************************************** LED HANDLING */
 void set_rgb(uint8_t r, uint8_t g, uint8_t b) {
-    set_color(10, r, g, b);
-    set_color(10, r, g, b);
-    set_color(10, r, g, b);
-}
-
-void wheel(uint8_t pos) {                   // Generates a smooth color transition
-    pos = 255 - pos;                        // Inverts input value
-    if (pos < 85) {                         // RED
-        set_rgb(255 - pos * 3, 0, pos * 3); // Transitions from red to purple (mixing red and blue)
-    } else if (pos < 170) {                 // GREEN 
-        pos = pos - 85;
-        set_rgb(0, pos * 3, 255 - pos * 3); // Transitions from purple to green (mixing blue and green)
-    } else {
-        pos = pos - 170;                    // BLUE
-        set_rgb(pos * 3, 255 - pos * 3, 0); // Transitions from green to red (mixing red and green)
-    }
+    strip_fill(r, g, b);
 }
 
-void set_prev_color() {
-    switch (led) {
-        case 6:
-            prev_color6[0] = color[0];
-            prev_color6[1] = color[1];
-            prev_color6[2] = color[2];
-            break;
-        case 7:
-            prev_color7[0] = color[0];
-            prev_color7[1] = color[1];
-            prev_color7[2] = color[2];
-            break;
-        case 8:
-            prev_color8[0] = color[0];
-            prev_color8[1] = color[1];
-            prev_color8[2] = color[2];
-            break;
-    }
+void set_color(rgb_t c) {                   // Gamma corrected output
+    c = color_gamma(c);
+    set_rgb(c.r, c.g, c.b);
 }
 
-void toggle_led(uint8_t led) {
-    set_transmit(START);
-    switch (led) {
-        case 6:
-            set_color(10, color[0], color[1], color[2]);
-            set_color(10, prev_color7[0], prev_color7[1], prev_color7[2]);
-            set_color(10, prev_color8[0], prev_color8[1], prev_color8[2]);
-            break;
-        case 7:
-            set_color(10, prev_color6[0], prev_color6[1], prev_color6[2]);
-            set_color(10, color[0], color[1], color[2]);
-            set_color(10, prev_color8[0], prev_color8[1], prev_color8[2]);
-            break;
-        case 8:
-            set_color(10, prev_color6[0], prev_color6[1], prev_color6[2]);
-            set_color(10, prev_color7[0], prev_color7[1], prev_color7[2]);
-            set_color(10, color[0], color[1], color[2]);
-            break;
-    }
-    set_transmit(END);
-}
+// *************************************************************** ANIMATION */
+// An animation = keyframes played in a loop by TIMER0_COMPA_vect, one frame per tick (10ms).
+// Each keyframe lasts `ticks` and is drawn from a 16-bit phase (0 -> 65535 over the keyframe)
+// advanced by a constant step, so a frame costs a few 8x8 multiplies and no division :
+// - ANIM_FADE    : all LEDs go from the previous keyframe color to (r, g, b)
+// - ANIM_CHASE   : (r, g, b) runs once along the strip, the other LEDs are off
+// - ANIM_RAINBOW : all LEDs go once around the color wheel, (r, g, b) unused
+// Built-in animations are in flash, the user animation (#KF lines) is saved in EEPROM.
+#define ANIM_FADE       'F'
+#define ANIM_CHASE      'C'
+#define ANIM_RAINBOW    'R'
+#define ANIM_MAX        16                  // Keyframes in the user animation
+#define ANIM_ADDR       0x380               // EEPROM : MAGIC_ANIM | count | keyframes | checksum
+#define MAGIC_ANIM      0xA7
+
+typedef struct {
+    uint8_t type;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t ticks;                          // Duration in 10ms ticks (1 - 255)
+} keyframe_t;
+
+typedef struct {
+    const char *name;
+    const keyframe_t *frames;               // Flash
+    uint8_t len;
+} anim_t;
+
+const keyframe_t anim_fade[] PROGMEM = {
+    {ANIM_FADE, 255, 0, 0, 100}, {ANIM_FADE, 0, 255, 0, 100}, {ANIM_FADE, 0, 0, 255, 100}
+};
+const keyframe_t anim_breathe[] PROGMEM = {
+    {ANIM_FADE, 255, 255, 255, 150}, {ANIM_FADE, 0, 0, 0, 150}
+};
+const keyframe_t anim_chase[] PROGMEM = {
+    {ANIM_CHASE, 255, 0, 0, 60}, {ANIM_CHASE, 0, 255, 0, 60}, {ANIM_CHASE, 0, 0, 255, 60}
+};
+const keyframe_t anim_rainbow[] PROGMEM = {
+    {ANIM_RAINBOW, 0, 0, 0, 255}            // 2.55s per turn, as the former #FULLRAINBOW
+};
+const anim_t anims[] = {
+    {"FADE", anim_fade, sizeof(anim_fade) / sizeof(keyframe_t)},
+    {"BREATHE", anim_breathe, sizeof(anim_breathe) / sizeof(keyframe_t)},
+    {"CHASE", anim_chase, sizeof(anim_chase) / sizeof(keyframe_t)},
+    {"RAINBOW", anim_rainbow, sizeof(anim_rainbow) / sizeof(keyframe_t)},
+};
+
+keyframe_t user_anim[ANIM_MAX];             // Edited by #KF lines
+uint8_t user_len = 0;
+volatile uint8_t save_request = 0;          // EEPROM writes happen in the main loop
+
+keyframe_t anim[ANIM_MAX];                  // Animation being played, ISR only once started
+uint8_t anim_len = 0;
+uint8_t anim_index = 0;
+uint16_t anim_phase = 0;                    // Q0.16 position in the keyframe
+uint16_t anim_step = 0;                     // Phase increment per tick
+uint8_t anim_left = 0;                      // Ticks left in the keyframe
+uint8_t anim_from[3];                       // Color at the start of the keyframe
+volatile uint8_t anim_playing = 0;
 
 void timer0_init() {
     TCCR0A |= (1 << WGM01);                 // CTC Mode
@@ -158,22 +445,122 @@ void timer0_init() {
     TIMSK0 |= (1 << OCIE0A);                // Enable Timer0 Compare Match A Interrupt
 }
 
-void set_mode() {
-    if (!rainbow) {
-        set_prev_color();
-        toggle_led(led);
-    }
+void anim_keyframe(uint8_t index) {
+    anim_index = index;
+    anim_phase = 0;
+    anim_left = anim[index].ticks;
+    anim_step = (anim[index].ticks > 1) ? 65535U / (anim[index].ticks - 1) : 0;
+}
+
+void anim_play(const keyframe_t *frames, uint8_t len, uint8_t in_flash) {
+    if (len == 0)
+        return ;
+    anim_playing = 0;                       // Timer0 ISR leaves anim[] alone
+    if (in_flash)
+        memcpy_P(anim, frames, len * sizeof(keyframe_t));
+    else
+        memcpy(anim, frames, len * sizeof(keyframe_t));
+    anim_len = len;
+    memset(anim_from, 0, sizeof(anim_from));
+    anim_keyframe(0);
+    anim_playing = 1;
+}
+
+uint8_t lerp(uint8_t a, uint8_t b, uint8_t t) {     // a -> b, t = 0 - 255
+    return (a + (((int16_t)b - a) * t >> 8));
+}
+
+void anim_draw(const keyframe_t *kf, uint8_t t) {
+    rgb_t c = {kf->r, kf->g, kf->b};
+    if (kf->type == ANIM_FADE) {
+        if (anim_left > 1) {                // Last tick : exact target
+            c.r = lerp(anim_from[0], kf->r, t);
+            c.g = lerp(anim_from[1], kf->g, t);
+            c.b = lerp(anim_from[2], kf->b, t);
+        }
+        set_color(c);
+    } else if (kf->type == ANIM_CHASE) {
+        c = color_gamma(c);
+        strip_fill(0, 0, 0);
+        strip_set(((uint16_t)t * LED_COUNT) >> 8, c.r, c.g, c.b);
+    } else
+        set_color(wheel(t));
+}
+
+void anim_tick(void) {
+    const keyframe_t *kf = &anim[anim_index];
+    anim_draw(kf, anim_phase >> 8);
+    strip_show();
+    if (--anim_left == 0) {                 // Keyframe done : next one starts from its color
+        anim_from[0] = kf->r;
+        anim_from[1] = kf->g;
+        anim_from[2] = kf->b;
+        anim_keyframe((anim_index + 1 < anim_len) ? anim_index + 1 : 0);
+    } else
+        anim_phase += anim_step;
 }
 
 ISR(TIMER0_COMPA_vect) {
-    if (rainbow) {
-        set_transmit(START);
-        wheel(pos);
-        set_transmit(END);
-        pos++;
-        if (pos == 255)
-            pos = 0;
+#if SLEEP_STATS
+    stats_tick++;                           // First : OCF0A is already cleared for stats_now()
+#endif
+    SLEEP_WAKE();
+    if (anim_playing)
+        anim_tick();
+}
+
+// ************************************************************ EEPROM SETUP */
+unsigned char EEPROM_read(uint16_t address) {
+    while (EECR & (1 << EEPE))  // Wait for completion of previous write
+        ;
+    EEAR = address;             // Set up address register
+    EECR |= (1 << EERE);        // Start eeprom read by writing EERE
+    return (EEDR);              // Return data from Data Register
+}
+
+void EEPROM_write(uint16_t address, unsigned char data) {
+    while (EECR & (1 << EEPE))  // Wait for completion of previous write
+        ;
+    EEAR = address;             // Set up address register
+    EEDR = data;                // Load data to register
+    cli();                      // EEMPE -> EEPE must be within 4 cycles
+    EECR |= (1 << EEMPE);       // Write logical 1 to eempe
+    EECR |= (1 << EEPE);        // Start eeprom write by setting EEPE
+    sei();
+}
+
+void anim_load(void) {                      // User animation from EEPROM, if any
+    uint8_t *bytes = (uint8_t *)user_anim;
+    uint8_t check = 0;
+    if (EEPROM_read(ANIM_ADDR) != MAGIC_ANIM)
+        return ;
+    uint8_t len = EEPROM_read(ANIM_ADDR + 1);
+    if (len == 0 || len > ANIM_MAX)
+        return ;
+    for (uint8_t j = 0; j < len * sizeof(keyframe_t); j++) {
+        bytes[j] = EEPROM_read(ANIM_ADDR + 2 + j);
+        check ^= bytes[j];
+    }
+    if (check == EEPROM_read(ANIM_ADDR + 2 + len * sizeof(keyframe_t)))
+        user_len = len;
+}
+
+void anim_save(void) {
+    keyframe_t frames[ANIM_MAX];
+    uint8_t check = 0;
+    cli();                                  // Snapshot : #KF lines arrive from USART_RX_vect
+    uint8_t len = user_len;
+    memcpy(frames, user_anim, sizeof(frames));
+    sei();
+    const uint8_t *bytes = (const uint8_t *)frames;
+    EEPROM_write(ANIM_ADDR, 0xFF);          // Invalid while rewriting
+    EEPROM_write(ANIM_ADDR + 1, len);
+    for (uint8_t j = 0; j < len * sizeof(keyframe_t); j++) {
+        EEPROM_write(ANIM_ADDR + 2 + j, bytes[j]);
+        check ^= bytes[j];
     }
+    EEPROM_write(ANIM_ADDR + 2 + len * sizeof(keyframe_t), check);
+    EEPROM_write(ANIM_ADDR, MAGIC_ANIM);    // Written last : a cut record stays invalid
 }
 
 // ***************************************************************** PARSING */
@@ -190,14 +577,90 @@ int char_to_int(char c)                     // Convert char to int in hex format
     return (-1);
 }
 
-void extract_rgb()
-{
-    if (input[0] == '#' && i == 9) {        // Check valid #RRGGBB format & convert to int
-        color[0] = char_to_int(input[1]) * 16 + char_to_int(input[2]);
-        color[1] = char_to_int(input[3]) * 16 + char_to_int(input[4]);
-        color[2] = char_to_int(input[5]) * 16 + char_to_int(input[6]);
-    } else
+uint8_t hex_byte(const char *s) {
+    return (char_to_int(s[0]) * 16 + char_to_int(s[1]));
+}
+
+// #RRGGBB [D<n> | D<n>-<m> ...] [#RRGGBB ...] : no LED after a color = every LED
+// e.g. #FF0000D6, #000000, #FF0000 D0-29 #0000FF D30-59, #00FF00 D6 D8
+// Checked first (apply = 0), then written to the frame buffer (apply = 1) : a bad line
+// changes nothing, a good one is pushed as a single frame.
+uint8_t parse_leds(const char *s, uint8_t apply) {
+    char *end;
+    while (*s) {
+        if (*s != '#' || strlen(s) < 7)
+            return (0);
+        uint8_t r = hex_byte(s + 1);
+        uint8_t g = hex_byte(s + 3);
+        uint8_t b = hex_byte(s + 5);
+        uint8_t targets = 0;
+        if (bad_input)
+            return (0);
+        s += 7;
+        while (1) {
+            while (*s == ' ')
+                s++;
+            if (*s != 'D')
+                break;
+            long first = strtol(s + 1, &end, 10);
+            long last = first;
+            if (end == s + 1)
+                return (0);
+            if (*end == '-') {
+                s = end + 1;
+                last = strtol(s, &end, 10);
+                if (end == s)
+                    return (0);
+            }
+            if (first < LED_FIRST || last < first || last >= LED_FIRST + LED_COUNT)
+                return (0);
+            if (apply)
+                for (uint16_t n = first; n <= last; n++)
+                    strip_set(n - LED_FIRST, r, g, b);
+            targets++;
+            s = end;
+        }
+        if (apply && !targets)
+            strip_fill(r, g, b);
+    }
+    return (1);
+}
+
+// #PLAY <FADE | BREATHE | CHASE | RAINBOW | USER>
+void parse_play(const char *name) {
+    if (strcmp(name, "USER") == 0 && user_len) {
+        anim_play(user_anim, user_len, 0);
+        return ;
+    }
+    for (uint8_t j = 0; j < sizeof(anims) / sizeof(anim_t); j++) {
+        if (strcmp(name, anims[j].name) == 0) {
+            anim_play(anims[j].frames, anims[j].len, 1);
+            return ;
+        }
+    }
+    bad_input = 1;
+}
+
+// #KF <F | C | R> RRGGBB <ticks> : appends a keyframe to the user animation
+void parse_keyframe(const char *s) {
+    keyframe_t kf;
+    char *end;
+    if (user_len == ANIM_MAX || (s[0] != ANIM_FADE && s[0] != ANIM_CHASE && s[0] != ANIM_RAINBOW)
+        || s[1] != ' ' || strlen(s) < 10 || s[8] != ' ') {
         bad_input = 1;
+        return ;
+    }
+    kf.type = s[0];
+    kf.r = char_to_int(s[2]) * 16 + char_to_int(s[3]);
+    kf.g = char_to_int(s[4]) * 16 + char_to_int(s[5]);
+    kf.b = char_to_int(s[6]) * 16 + char_to_int(s[7]);
+    long ticks = strtol(&s[9], &end, 10);
+    if (*end || ticks < 1 || ticks > 255)
+        bad_input = 1;
+    if (bad_input)
+        return ;
+    kf.ticks = ticks;
+    user_anim[user_len++] = kf;
 }
 
 void parse_input() {
@@ -206,16 +669,20 @@ void parse_input() {
         return ;
     }
     if (strcmp(input, "#FULLRAINBOW") == 0)
-        rainbow = 1;
-    else {
-        extract_rgb();
-        if (input[7] == 'D') {
-            led = atoi(&input[8]);
-            if (led >= 6 && led <= 8)
-            return ;
-        }
+        parse_play("RAINBOW");
+    else if (strncmp(input, "#PLAY ", 6) == 0)
+        parse_play(&input[6]);
+    else if (strncmp(input, "#KF ", 4) == 0)
+        parse_keyframe(&input[4]);
+    else if (strcmp(input, "#KFCLEAR") == 0)
+        user_len = 0;
+    else if (strcmp(input, "#KFSAVE") == 0)
+        save_request = 1;
+    else if (parse_leds(input, 0)) {
+        parse_leds(input, 1);
+        strip_show();
+    } else
         bad_input = 1;
-    }
 }
 
 // ********************************************************** INPUT HANDLING */
@@ -243,19 +710,18 @@ void handle_enter()
     parse_input();
     if (bad_input)
         handle_bad_input();
-    else
-        set_mode();
     i = 0;
 }
 
-ISR(USART_RX_vect) {  
+ISR(USART_RX_vect) {
+    SLEEP_WAKE();
     char c = UDR0;                      // Read received data
-    rainbow = 0;
+    anim_playing = 0;                   // Typing stops the animation
     if (c == 8 || c == 127)             // Handle backspace
         handle_backspace();
     else if (c == 10 || c == 13)        // Handle enter
         handle_enter();
-    else if (i < 12)
+    else if (i < sizeof(input) - 1)
     {
         uart_tx(c);
         input[i] = c;
@@ -264,11 +730,23 @@ ISR(USART_RX_vect) {
 }
 
 int main() {
+    power_init();
     SPI_master_init();
+    strip_init();
     uart_init();
     timer0_init();
+    anim_load();
     sei();
     while (1) {
+        if (save_request) {
+            anim_save();
+            save_request = 0;
+            uart_printstr(GREEN);
+            uart_printstr(SAVED);
+            uart_printstr(RESET);
+            uart_printstr(NEXT_LINE);
+        }
+        idle();
     }
     return (0);
 }
\ No newline at end of file
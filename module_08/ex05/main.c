@@ -3,19 +3,18 @@
 #include <avr/interrupt.h>
 
 #define DEBOUNCE_DELAY 20
+#define TOP_TIMER0 (F_CPU / 64UL / 1000 - 1)  // 1ms interrupt period = 249
 #define DDR_SPI DDRB
 #define SS      PB2             // Slave Select (SK9822 uses no SS, but keep low)
 #define MOSI    PB3             // SPI MOSI (Data Out)
 #define SCK     PB5             // SPI Clock
+#define SPI_DIV 2               // SPI clock = F_CPU / 2 = 8MHz (SK9822 accepts up to 30MHz)
 #define START   (uint8_t)0x00   // Start frame
-#define END     (uint8_t)0xFF   // End frame
+#define POT_DELTA 2             // Pot noise below this does not re-send the frame
 
 uint8_t curr_color = 0;
 uint8_t curr_led = 0;
 uint8_t color[3];
-static uint8_t prev_color6[3] = {0, 0, 0};
-static uint8_t prev_color7[3] = {0, 0, 0};
-static uint8_t prev_color8[3] = {0, 0, 0};
 
 // *********************************************************** BUTTONS SETUP */
 void buttons_init() {
@@ -25,6 +24,28 @@ void buttons_init() {
     PORTD |= (1 << PD2) | (1 << PD4);
 }
 
+// ************************************************************* SYSTEM TICK */
+volatile uint16_t ms_ticks = 0;
+
+void timer0_init(void) {
+    TCCR0A = (1 << WGM01);                  // CTC Mode
+    TCCR0B = (1 << CS01) | (1 << CS00);     // Prescaler 64
+    OCR0A = TOP_TIMER0;                     // Interrupt every 1ms
+    TIMSK0 |= (1 << OCIE0A);                // Enable Timer0 Compare Match A Interrupt
+}
+
+ISR(TIMER0_COMPA_vect) {
+    ms_ticks++;
+}
+
+uint16_t millis(void) {
+    uint16_t now;
+    cli();                                  // 16-bit read must not be torn by the ISR
+    now = ms_ticks;
+    sei();
+    return (now);
+}
+
 // *************************************************************** ADC SETUP */
 void adc_init(void) {
     ADMUX = (1 << REFS0) | (1 << ADLAR);    // Set AVCC voltage reference, ADC Left Adjust Result
@@ -40,13 +61,62 @@ uint8_t adc_read(void) {
     return (ADCH);                          // Read 8-bit ADC result
 }
 
+// ************************************************************** ADC EVENTS */
+// Consumers only run on an event instead of on every sample :
+// - ADC_EV_CHANGE : value moved by at least `delta` since the last report (or hit 0 / 255)
+// - ADC_EV_LEVEL  : value crossed one of `thresholds`, with `hysteresis` on the way down
+#define ADC_EV_CHANGE   0x01
+#define ADC_EV_LEVEL    0x02
+
+typedef struct {
+    uint8_t value;                          // Last reported value
+    uint8_t delta;
+    uint8_t level;                          // Number of thresholds reached
+    uint8_t hysteresis;
+    uint8_t nb_thresholds;
+    const uint8_t *thresholds;              // Ascending
+} adc_event_t;
+
+uint8_t adc_event_update(adc_event_t *ev, uint8_t sample) {
+    uint8_t events = 0;
+    uint8_t diff = (sample > ev->value) ? sample - ev->value : ev->value - sample;
+
+    if (diff >= ev->delta || (diff && (sample == 0 || sample == 255))) {
+        ev->value = sample;
+        events |= ADC_EV_CHANGE;
+    }
+    uint8_t level = ev->level;
+    while (level < ev->nb_thresholds && sample >= ev->thresholds[level])
+        level++;
+    while (level > 0 && sample + ev->hysteresis < ev->thresholds[level - 1])
+        level--;
+    if (level != ev->level) {
+        ev->level = level;
+        events |= ADC_EV_LEVEL;
+    }
+    return (events);
+}
+
 // *************************************************************** SPI SETUP */
+void SPI_set_clock(uint8_t div) {          // SPI clock = F_CPU / div, div = 2, 4, 8 ... 128
+    uint8_t spr = 0;                        // SPR1:0 = 0 -> /4, 1 -> /16, 2 -> /64, 3 -> /128
+    uint8_t x2 = (div == 2 || div == 8 || div == 32);
+    if (x2)
+        div <<= 1;                          // SPI2X doubles the rate of the next slower setting
+    while (div > 4 && spr < 3) {
+        div >>= 2;
+        spr++;
+    }
+    SPCR = (SPCR & ~((1 << SPR1) | (1 << SPR0))) | spr;
+    SPSR = x2 ? (1 << SPI2X) : 0;
+}
+
 void SPI_master_init(void) {
     DDR_SPI = (1 << MOSI) | (1 << SCK)      // Set MOSI and SCK output, 
         | (1 << SS);                        // SS output - deactivate slave
     PORTB &= ~(1 << PB2);                   // Set SS output
-    SPCR = (1 << SPE)| (1 << MSTR)          // Enable SPI & Master
-        | (1 << SPR0);                      // Set clock rate f_osc/16
+    SPCR = (1 << SPE)| (1 << MSTR);         // Enable SPI & Master
+    SPI_set_clock(SPI_DIV);
 }
 
 void SPI_master_transmit(char data) {
@@ -60,96 +130,112 @@ void set_transmit(uint8_t frame) {
         SPI_master_transmit(frame);         // Then send LED frame
 }
 
-void set_color(uint8_t brightness, uint8_t red, uint8_t green, uint8_t blue) {
-    SPI_master_transmit(0xE0 | (brightness & 0x1F));
-    SPI_master_transmit(blue);
-    SPI_master_transmit(green);
-    SPI_master_transmit(red);
+// *************************************************************** LED STRIP */
+// Frame buffer in wire format, 4 bytes per LED : 0xE0 | brightness, blue, green, red
+// show() = start frame | buffer | SK9822 reset frame | end frame (1 clock edge per 2 LEDs)
+// Setters only mark the strip dirty when a byte actually changes. show() sends nothing
+// while the strip is clean, at most one frame per LED_FRAME_MS, and stops after the last
+// dirty LED : the following LEDs see the reset frame as a start frame & keep their color.
+#define LED_COUNT       3                   // 3 LEDs on the devkit, up to 255 on a strip
+#define LED_BRIGHTNESS  10                  // Default global brightness (0 - 31)
+#define LED_FRAME_MS    10                  // Frame rate cap = 100 frames/s
+#define LED_END_BYTES(n) (((n) + 15) / 16)
+
+uint8_t strip[LED_COUNT][4];
+uint8_t strip_dirty = 0;                    // Number of LEDs to send, 0 = nothing changed
+uint16_t strip_last_show = 0;               // millis() of the last frame sent
+
+void strip_write(uint8_t n, uint8_t byte, uint8_t value) {
+    if (strip[n][byte] == value)
+        return ;
+    strip[n][byte] = value;
+    if (n >= strip_dirty)
+        strip_dirty = n + 1;
 }
 
-// ********************************************************** LED HANDLING */
-void set_prev_color() {
-    switch (curr_led) {
-        case 0:
-            prev_color6[0] = color[0];
-            prev_color6[1] = color[1];
-            prev_color6[2] = color[2];
-            break;
-        case 1:
-            prev_color7[0] = color[0];
-            prev_color7[1] = color[1];
-            prev_color7[2] = color[2];
-            break;
-        case 2:
-            prev_color8[0] = color[0];
-            prev_color8[1] = color[1];
-            prev_color8[2] = color[2];
-            break;
-    }
+void strip_set(uint8_t n, uint8_t red, uint8_t green, uint8_t blue) {
+    strip_write(n, 1, blue);
+    strip_write(n, 2, green);
+    strip_write(n, 3, red);
 }
 
-void toggle_led() {
+void strip_set_brightness(uint8_t n, uint8_t brightness) {
+    strip_write(n, 0, 0xE0 | (brightness & 0x1F));
+}
+
+void strip_fill(uint8_t red, uint8_t green, uint8_t blue) {
+    for (uint8_t n = 0; n < LED_COUNT; n++)
+        strip_set(n, red, green, blue);
+}
+
+void strip_init(void) {
+    for (uint8_t n = 0; n < LED_COUNT; n++)
+        strip_set_brightness(n, LED_BRIGHTNESS);
+    strip_fill(0, 0, 0);
+    strip_dirty = LED_COUNT;                // First frame : LEDs are in an unknown state
+}
+
+uint8_t strip_show(void) {                  // Return 1 if a frame was sent
+    if (!strip_dirty)
+        return (0);
+    uint16_t now = millis();
+    if ((uint16_t)(now - strip_last_show) < LED_FRAME_MS)
+        return (0);                         // Too soon : stays dirty, sent on a later call
+    strip_last_show = now;
+
+    const uint8_t *p = &strip[0][0];
     set_transmit(START);
-    switch (curr_led) {
-        case 0:
-            set_color(10, color[0], color[1], color[2]);
-            set_color(10, prev_color7[0], prev_color7[1], prev_color7[2]);
-            set_color(10, prev_color8[0], prev_color8[1], prev_color8[2]);
-            break;
-        case 1:
-            set_color(10, prev_color6[0], prev_color6[1], prev_color6[2]);
-            set_color(10, color[0], color[1], color[2]);
-            set_color(10, prev_color8[0], prev_color8[1], prev_color8[2]);
-            break;
-        case 2:
-            set_color(10, prev_color6[0], prev_color6[1], prev_color6[2]);
-            set_color(10, prev_color7[0], prev_color7[1], prev_color7[2]);
-            set_color(10, color[0], color[1], color[2]);
-            break;
-    }
-    set_transmit(END);
-}
-
-void update_leds(uint8_t value) {
-    switch (curr_color) {
-        case 0:
-            color[0] = value;
-            break;
-        case 1:
-            color[1] = value;
-            break;
-        case 2:
-            color[2] = value;
-            break;
-    }
-    set_prev_color();
-    toggle_led(curr_led);
+    for (uint16_t j = 0; j < (uint16_t)strip_dirty * 4; j++)
+        SPI_master_transmit(*p++);
+    set_transmit(START);                    // SK9822 : 32 zero bits latch the new colors
+    for (uint8_t j = 0; j < LED_END_BYTES(strip_dirty); j++)
+        SPI_master_transmit(START);         // Zeros : pushes the data through, lights nothing
+    strip_dirty = 0;
+    return (1);
 }
 
-void check_buttons()
+// ********************************************************** LED HANDLING */
+void update_leds(uint8_t value) {          // Only touches the buffer, strip_show() sends it
+    color[curr_color] = value;
+    strip_set(curr_led, color[0], color[1], color[2]);
+}
+
+uint8_t check_buttons()                     // Return 1 if the selection changed
 {
     // Change color if button SW1 (PD2) is pressed
     if (!(PIND & (1 << PD2))) {
         _delay_ms(DEBOUNCE_DELAY);
-        if ((PIND & (1 << PD2)))
-            curr_color = (curr_color + 1) % 3; 
+        if ((PIND & (1 << PD2))) {
+            curr_color = (curr_color + 1) % 3;
+            return (1);
+        }
     }
     // Change LED if button SW2 (PD3) is pressed
     else if (!(PIND & (1 << PD4))) {
         _delay_ms(DEBOUNCE_DELAY);
-        if ((PIND & (1 << PD4)))
-            curr_led = (curr_led + 1) % 3;
+        if ((PIND & (1 << PD4))) {
+            curr_led = (curr_led + 1) % LED_COUNT;
+            return (1);
+        }
     }
+    return (0);
 }
 
 int main() {
+    timer0_init();
     SPI_master_init();
+    strip_init();
     buttons_init();
     adc_init();
+    sei();
+    adc_event_t pot = {.delta = POT_DELTA};
+    adc_event_update(&pot, adc_read());
+    update_leds(pot.value);                 // Initial frame, then only on changes
     while (1) {
-        uint8_t value = adc_read();
-        check_buttons();
-        update_leds(value);
+        uint8_t events = adc_event_update(&pot, adc_read());
+        if (check_buttons() || (events & ADC_EV_CHANGE))
+            update_leds(pot.value);
+        strip_show();                       // No-op while nothing changed or too soon
     }
     return (0);
 }
\ No newline at end of file
@@ -0,0 +1,403 @@
+#include <avr/io.h>
+#include <util/delay.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#define UART_BAUDRATE 115200
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
+
+#define DDR_SPI DDRB
+#define SS      PB2             // Slave Select (SK9822 uses no SS, but keep low)
+#define MOSI    PB3             // SPI MOSI (Data Out)
+#define SCK     PB5             // SPI Clock
+#define XCK0    PD4             // USART in SPI mode : clock (data out on TXD0 = PD1)
+#define START   (uint8_t)0x00   // Start frame
+
+#define MAX_LEDS    144
+#define NB_FRAMES   16          // Frames sent per measurement
+#define END_BYTES(n) (((n) + 15) / 16)
+
+// Max frames/s of an SK9822 strip for 3, 60 & 144 LEDs with each LED output backend :
+// - SPI polling SPIF at f_osc/16 (previous setting), f_osc/4 and f_osc/2 (SPI2X)
+// - USART0 in Master SPI mode at f_osc/2 : double-buffered UDR0, no gap between bytes
+// Results are printed over UART once USART0 is back in asynchronous mode.
+// Then the CPU cycles of each COLOR conversion (Timer1 without prescaler).
+// USART SPI uses TXD0 / XCK0 (PD1 / PD4) : wire an external strip there, the devkit LEDs
+// stay on the SPI pins, and the serial console is unavailable while it streams.
+
+uint8_t strip[MAX_LEDS][4];
+const uint8_t nb_leds[] = {3, 60, 144};
+
+// ************************************************************** UART SETUP */
+void uart_init() {
+    UCSR0B = 0;
+    UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // Set frame format to 8N1 (8-bit frame, 1 stop bit, no parity)
+    UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
+    UBRR0L = (unsigned char)MYUBRR;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
+    UCSR0B = (1 << TXEN0);                  // Enable transmitter
+}
+
+void uart_tx(const char c) {
+    while (!(UCSR0A & (1 << UDRE0)))        // Wait for empty transmit buffer (if 0, buffer = full)
+        ;
+    UDR0 = c;                               // Put data into buffer, sends data
+}
+
+void uart_printstr(const char *str) {
+    while (*str)
+        uart_tx(*str++);
+}
+
+void uart_flush(void) {                     // Last byte out before USART0 changes mode
+    UCSR0A |= (1 << TXC0);
+    uart_tx(0);
+    while (!(UCSR0A & (1 << TXC0)))
+        ;
+}
+
+void uart_printnbr(uint32_t n) {
+    char buf[11];
+    uint8_t i = 0;
+    do {
+        buf[i++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    while (i)
+        uart_tx(buf[--i]);
+}
+
+// *************************************************************** SPI SETUP */
+void SPI_set_clock(uint8_t div) {          // SPI clock = F_CPU / div, div = 2, 4, 8 ... 128
+    uint8_t spr = 0;                        // SPR1:0 = 0 -> /4, 1 -> /16, 2 -> /64, 3 -> /128
+    uint8_t x2 = (div == 2 || div == 8 || div == 32);
+    if (x2)
+        div <<= 1;                          // SPI2X doubles the rate of the next slower setting
+    while (div > 4 && spr < 3) {
+        div >>= 2;
+        spr++;
+    }
+    SPCR = (SPCR & ~((1 << SPR1) | (1 << SPR0))) | spr;
+    SPSR = x2 ? (1 << SPI2X) : 0;
+}
+
+void SPI_master_init(void) {
+    DDR_SPI = (1 << MOSI) | (1 << SCK)      // Set MOSI and SCK output,
+        | (1 << SS);                        // SS output - deactivate slave
+    PORTB &= ~(1 << PB2);                   // Set SS output
+    SPCR = (1 << SPE)| (1 << MSTR);         // Enable SPI & Master
+}
+
+void SPI_master_transmit(char data) {
+    SPDR = data;                            // Start transmission
+    while(!(SPSR & (1 << SPIF)))            // Wait for transmission to complete
+        ;
+}
+
+// ************************************************************ USART IN SPI */
+void usart_spi_init(void) {
+    UBRR0 = 0;                              // Must be 0 while the transmitter is enabled
+    UCSR0A = (1 << TXC0);                   // Clear TXC0 left by uart_flush(), U2X0 written to zero
+    DDRD |= (1 << XCK0);                    // XCK0 output = master
+    UCSR0C = (1 << UMSEL01) | (1 << UMSEL00);   // Master SPI mode, MSB first, SPI mode 0
+    UCSR0B = (1 << TXEN0);
+    UBRR0 = 0;                              // Clock = F_CPU / (2 * (UBRR0 + 1)) = 8MHz
+}
+
+void usart_spi_transmit(uint8_t data) {
+    while (!(UCSR0A & (1 << UDRE0)))        // Free as soon as the previous byte moved to the
+        ;                                   // shift register : bytes go out back to back
+    UDR0 = data;
+}
+
+void usart_spi_flush(void) {
+    while (!(UCSR0A & (1 << TXC0)))
+        ;
+    DDRD &= ~(1 << XCK0);
+}
+
+// ******************************************************************* COLOR */
+// Tables from module_03/ex02/gen_color_tables.py, read from flash (3 cycles per LPM) :
+// - wheel()      : 3 table reads instead of compare + multiply branches
+// - hsv_to_rgb() : 6 sectors, 8x8 multiplies only (hardware MUL, 2 cycles each)
+// - color_gamma(): 3 table reads, applied last so fades look linear to the eye
+// color_bench() below prints the cycle count of each conversion.
+typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} rgb_t;
+
+// Generated by module_03/ex02/gen_color_tables.py : gamma 2.8
+const uint8_t gamma8_table[256] PROGMEM = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+      5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+     10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+     17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+     25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+     37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+     51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+     69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+     90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+    115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+    144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+    177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+    215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255
+};
+
+const uint8_t wheel_table[256][3] PROGMEM = {
+    {255,   0,   0}, {252,   3,   0}, {249,   6,   0}, {246,   9,   0},
+    {243,  12,   0}, {240,  15,   0}, {237,  18,   0}, {234,  21,   0},
+    {231,  24,   0}, {228,  27,   0}, {225,  30,   0}, {222,  33,   0},
+    {219,  36,   0}, {216,  39,   0}, {213,  42,   0}, {210,  45,   0},
+    {207,  48,   0}, {204,  51,   0}, {201,  54,   0}, {198,  57,   0},
+    {195,  60,   0}, {192,  63,   0}, {189,  66,   0}, {186,  69,   0},
+    {183,  72,   0}, {180,  75,   0}, {177,  78,   0}, {174,  81,   0},
+    {171,  84,   0}, {168,  87,   0}, {165,  90,   0}, {162,  93,   0},
+    {159,  96,   0}, {156,  99,   0}, {153, 102,   0}, {150, 105,   0},
+    {147, 108,   0}, {144, 111,   0}, {141, 114,   0}, {138, 117,   0},
+    {135, 120,   0}, {132, 123,   0}, {129, 126,   0}, {126, 129,   0},
+    {123, 132,   0}, {120, 135,   0}, {117, 138,   0}, {114, 141,   0},
+    {111, 144,   0}, {108, 147,   0}, {105, 150,   0}, {102, 153,   0},
+    { 99, 156,   0}, { 96, 159,   0}, { 93, 162,   0}, { 90, 165,   0},
+    { 87, 168,   0}, { 84, 171,   0}, { 81, 174,   0}, { 78, 177,   0},
+    { 75, 180,   0}, { 72, 183,   0}, { 69, 186,   0}, { 66, 189,   0},
+    { 63, 192,   0}, { 60, 195,   0}, { 57, 198,   0}, { 54, 201,   0},
+    { 51, 204,   0}, { 48, 207,   0}, { 45, 210,   0}, { 42, 213,   0},
+    { 39, 216,   0}, { 36, 219,   0}, { 33, 222,   0}, { 30, 225,   0},
+    { 27, 228,   0}, { 24, 231,   0}, { 21, 234,   0}, { 18, 237,   0},
+    { 15, 240,   0}, { 12, 243,   0}, {  9, 246,   0}, {  6, 249,   0},
+    {  3, 252,   0}, {  0, 255,   0}, {  0, 252,   3}, {  0, 249,   6},
+    {  0, 246,   9}, {  0, 243,  12}, {  0, 240,  15}, {  0, 237,  18},
+    {  0, 234,  21}, {  0, 231,  24}, {  0, 228,  27}, {  0, 225,  30},
+    {  0, 222,  33}, {  0, 219,  36}, {  0, 216,  39}, {  0, 213,  42},
+    {  0, 210,  45}, {  0, 207,  48}, {  0, 204,  51}, {  0, 201,  54},
+    {  0, 198,  57}, {  0, 195,  60}, {  0, 192,  63}, {  0, 189,  66},
+    {  0, 186,  69}, {  0, 183,  72}, {  0, 180,  75}, {  0, 177,  78},
+    {  0, 174,  81}, {  0, 171,  84}, {  0, 168,  87}, {  0, 165,  90},
+    {  0, 162,  93}, {  0, 159,  96}, {  0, 156,  99}, {  0, 153, 102},
+    {  0, 150, 105}, {  0, 147, 108}, {  0, 144, 111}, {  0, 141, 114},
+    {  0, 138, 117}, {  0, 135, 120}, {  0, 132, 123}, {  0, 129, 126},
+    {  0, 126, 129}, {  0, 123, 132}, {  0, 120, 135}, {  0, 117, 138},
+    {  0, 114, 141}, {  0, 111, 144}, {  0, 108, 147}, {  0, 105, 150},
+    {  0, 102, 153}, {  0,  99, 156}, {  0,  96, 159}, {  0,  93, 162},
+    {  0,  90, 165}, {  0,  87, 168}, {  0,  84, 171}, {  0,  81, 174},
+    {  0,  78, 177}, {  0,  75, 180}, {  0,  72, 183}, {  0,  69, 186},
+    {  0,  66, 189}, {  0,  63, 192}, {  0,  60, 195}, {  0,  57, 198},
+    {  0,  54, 201}, {  0,  51, 204}, {  0,  48, 207}, {  0,  45, 210},
+    {  0,  42, 213}, {  0,  39, 216}, {  0,  36, 219}, {  0,  33, 222},
+    {  0,  30, 225}, {  0,  27, 228}, {  0,  24, 231}, {  0,  21, 234},
+    {  0,  18, 237}, {  0,  15, 240}, {  0,  12, 243}, {  0,   9, 246},
+    {  0,   6, 249}, {  0,   3, 252}, {  0,   0, 255}, {  3,   0, 252},
+    {  6,   0, 249}, {  9,   0, 246}, { 12,   0, 243}, { 15,   0, 240},
+    { 18,   0, 237}, { 21,   0, 234}, { 24,   0, 231}, { 27,   0, 228},
+    { 30,   0, 225}, { 33,   0, 222}, { 36,   0, 219}, { 39,   0, 216},
+    { 42,   0, 213}, { 45,   0, 210}, { 48,   0, 207}, { 51,   0, 204},
+    { 54,   0, 201}, { 57,   0, 198}, { 60,   0, 195}, { 63,   0, 192},
+    { 66,   0, 189}, { 69,   0, 186}, { 72,   0, 183}, { 75,   0, 180},
+    { 78,   0, 177}, { 81,   0, 174}, { 84,   0, 171}, { 87,   0, 168},
+    { 90,   0, 165}, { 93,   0, 162}, { 96,   0, 159}, { 99,   0, 156},
+    {102,   0, 153}, {105,   0, 150}, {108,   0, 147}, {111,   0, 144},
+    {114,   0, 141}, {117,   0, 138}, {120,   0, 135}, {123,   0, 132},
+    {126,   0, 129}, {129,   0, 126}, {132,   0, 123}, {135,   0, 120},
+    {138,   0, 117}, {141,   0, 114}, {144,   0, 111}, {147,   0, 108},
+    {150,   0, 105}, {153,   0, 102}, {156,   0,  99}, {159,   0,  96},
+    {162,   0,  93}, {165,   0,  90}, {168,   0,  87}, {171,   0,  84},
+    {174,   0,  81}, {177,   0,  78}, {180,   0,  75}, {183,   0,  72},
+    {186,   0,  69}, {189,   0,  66}, {192,   0,  63}, {195,   0,  60},
+    {198,   0,  57}, {201,   0,  54}, {204,   0,  51}, {207,   0,  48},
+    {210,   0,  45}, {213,   0,  42}, {216,   0,  39}, {219,   0,  36},
+    {222,   0,  33}, {225,   0,  30}, {228,   0,  27}, {231,   0,  24},
+    {234,   0,  21}, {237,   0,  18}, {240,   0,  15}, {243,   0,  12},
+    {246,   0,   9}, {249,   0,   6}, {252,   0,   3}, {255,   0,   0}
+};
+
+rgb_t wheel(uint8_t pos) {                  // Smooth red -> purple -> green -> red transition
+    const uint8_t *p = wheel_table[pos];
+    rgb_t c = {pgm_read_byte(p), pgm_read_byte(p + 1), pgm_read_byte(p + 2)};
+    return (c);
+}
+
+rgb_t hsv_to_rgb(uint8_t h, uint8_t s, uint8_t v) {   // Hue, saturation, value : 0 - 255
+    if (s == 0) {
+        rgb_t grey = {v, v, v};
+        return (grey);
+    }
+    uint16_t h6 = h * 6;
+    uint8_t region = h6 >> 8;               // Sector 0 - 5
+    uint8_t rem = h6 & 0xFF;                // Position in the sector
+    uint8_t p = (v * (uint8_t)(255 - s)) >> 8;
+    uint8_t q = (v * (uint8_t)(255 - ((s * rem) >> 8))) >> 8;
+    uint8_t t = (v * (uint8_t)(255 - ((s * (uint8_t)(255 - rem)) >> 8))) >> 8;
+    rgb_t c;
+    switch (region) {
+        case 0: c.r = v; c.g = t; c.b = p; break;
+        case 1: c.r = q; c.g = v; c.b = p; break;
+        case 2: c.r = p; c.g = v; c.b = t; break;
+        case 3: c.r = p; c.g = q; c.b = v; break;
+        case 4: c.r = t; c.g = p; c.b = v; break;
+        default: c.r = v; c.g = p; c.b = q; break;
+    }
+    return (c);
+}
+
+uint8_t gamma8(uint8_t value) {
+    return (pgm_read_byte(&gamma8_table[value]));
+}
+
+rgb_t color_gamma(rgb_t c) {
+    c.r = gamma8(c.r);
+    c.g = gamma8(c.g);
+    c.b = gamma8(c.b);
+    return (c);
+}
+
+rgb_t wheel_arith(uint8_t pos) {            // Former wheel(), for comparison
+    rgb_t c;
+    pos = 255 - pos;
+    if (pos < 85) {
+        c.r = 255 - pos * 3; c.g = 0; c.b = pos * 3;
+    } else if (pos < 170) {
+        pos = pos - 85;
+        c.r = 0; c.g = pos * 3; c.b = 255 - pos * 3;
+    } else {
+        pos = pos - 170;
+        c.r = pos * 3; c.g = 255 - pos * 3; c.b = 0;
+    }
+    return (c);
+}
+
+// ******************************************************************* FRAME */
+void frame_spi(uint8_t n) {
+    const uint8_t *p = &strip[0][0];
+    for (uint8_t j = 0; j < 4; j++)
+        SPI_master_transmit(START);
+    for (uint16_t j = 0; j < (uint16_t)n * 4; j++)
+        SPI_master_transmit(*p++);
+    for (uint8_t j = 0; j < 4 + END_BYTES(n); j++)
+        SPI_master_transmit(START);
+}
+
+void frame_usart(uint8_t n) {
+    const uint8_t *p = &strip[0][0];
+    for (uint8_t j = 0; j < 4; j++)
+        usart_spi_transmit(START);
+    for (uint16_t j = 0; j < (uint16_t)n * 4; j++)
+        usart_spi_transmit(*p++);
+    for (uint8_t j = 0; j < 4 + END_BYTES(n); j++)
+        usart_spi_transmit(START);
+}
+
+// ****************************************************************** TIMING */
+uint16_t measure(void (*frame)(uint8_t), uint8_t n) {   // Timer1 ticks (4us) for NB_FRAMES
+    TCNT1 = 0;
+    TCCR1B = (1 << CS11) | (1 << CS10);     // Prescaler 64 : 262ms range
+    for (uint8_t f = 0; f < NB_FRAMES; f++)
+        frame(n);
+    TCCR1B = 0;
+    return (TCNT1);
+}
+
+volatile uint8_t bench_in = 200;            // volatile : nothing is folded at compile time
+volatile rgb_t bench_out;
+
+void cycles_start(void) {
+    TCNT1 = 0;
+    TCCR1B = (1 << CS10);                   // No prescaler : 1 tick = 1 cycle
+}
+
+uint16_t cycles_stop(void) {
+    TCCR1B = 0;
+    return (TCNT1);
+}
+
+void print_cycles(const char *name, uint16_t cycles, uint16_t overhead) {
+    uart_printstr(name);
+    uart_printstr(" : ");
+    uart_printnbr(cycles - overhead);
+    uart_printstr(" cycles\r\n");
+}
+
+void color_bench(void) {
+    uint16_t overhead, t;
+    cycles_start();
+    bench_out.r = bench_in;
+    overhead = cycles_stop();               // Timer start / stop + volatile accesses
+
+    cycles_start();
+    bench_out = wheel_arith(bench_in);
+    t = cycles_stop();
+    print_cycles("wheel arithmetic", t, overhead);
+    cycles_start();
+    bench_out = wheel(bench_in);
+    t = cycles_stop();
+    print_cycles("wheel table     ", t, overhead);
+    cycles_start();
+    bench_out = hsv_to_rgb(bench_in, 255, 255);
+    t = cycles_stop();
+    print_cycles("hsv_to_rgb      ", t, overhead);
+    cycles_start();
+    bench_out = color_gamma(wheel(bench_in));
+    t = cycles_stop();
+    print_cycles("wheel + gamma   ", t, overhead);
+}
+
+void print_result(const char *name, uint8_t n, uint16_t ticks) {
+    uart_printstr(name);
+    uart_printstr(" ");
+    uart_printnbr(n);
+    uart_printstr(" LEDs : ");
+    uart_printnbr((F_CPU / 64UL) * NB_FRAMES / ticks);
+    uart_printstr(" frames/s\r\n");
+}
+
+int main() {
+    uint16_t ticks[3];
+    for (uint8_t n = 0; n < MAX_LEDS; n++) {
+        strip[n][0] = 0xE0 | 1;             // Dim white
+        strip[n][1] = strip[n][2] = strip[n][3] = 0x10;
+    }
+    SPI_master_init();
+    uart_init();
+    uart_printstr("\r\nSK9822 max frame rate\r\n");
+
+    const uint8_t divs[] = {16, 4, 2};
+    const char *names[] = {"SPI  f_osc/16", "SPI  f_osc/4 ", "SPI  f_osc/2 "};
+    for (uint8_t d = 0; d < 3; d++) {
+        SPI_set_clock(divs[d]);
+        for (uint8_t k = 0; k < 3; k++)
+            print_result(names[d], nb_leds[k], measure(frame_spi, nb_leds[k]));
+    }
+
+    uart_flush();
+    usart_spi_init();
+    for (uint8_t k = 0; k < 3; k++)
+        ticks[k] = measure(frame_usart, nb_leds[k]);
+    usart_spi_flush();
+    uart_init();
+    for (uint8_t k = 0; k < 3; k++)
+        print_result("USART f_osc/2 ", nb_leds[k], ticks[k]);
+    color_bench();
+    while (1)
+        ;
+    return (0);
+}
@@ -1,5 +1,6 @@
 #include <avr/io.h>
 #include <util/delay.h>
+#include <avr/interrupt.h>
 
 #define SLA_ADDR    0x20
 #define SLA_R       ((SLA_ADDR << 1) | 1)   // 0x71 = 8-bit address for read
@@ -7,6 +8,7 @@
 #define CONF_0      0x06
 #define INPUT_0     0x00
 #define OUTPUT_0    0x02
+#define TOP_TIMER0  (F_CPU / 1024UL / 200 - 1)  // 5ms input tick = 77
 
 // ************************************************************** I2C SETUP */
 void i2c_init(void) {
@@ -59,26 +61,123 @@ unsigned char read_data(uint8_t reg) {
     return (data);
 }
 
+// ******************************************************************* INPUT */
+// All buttons sampled on a 5ms Timer0 tick, one bit each : SW1 (PD2), SW2 (PD4), SW3 (PCA9555
+// IO0_0). The ISR never waits : SW3 is read over I2C by the main loop into sw3_raw.
+// Vertical counters debounce the 8 bits at once : a bit changes state after 4 equal samples.
+// Events go to a queue read by input_pop() : press, release, long press after INPUT_LONG_MS,
+// then repeat every INPUT_REPEAT_MS while held.
+#define BTN_SW1         0
+#define BTN_SW2         1
+#define BTN_SW3         2
+#define NB_BUTTONS      3
+#define INPUT_TICK_MS   5
+#define INPUT_LONG_MS   600
+#define INPUT_REPEAT_MS 150
+#define INPUT_QUEUE     16                  // Power of 2
+
+#define EV_PRESS        0x10
+#define EV_RELEASE      0x20
+#define EV_LONG         0x30
+#define EV_REPEAT       0x40
+#define EV_TYPE(ev)     ((ev) & 0xF0)
+#define EV_BUTTON(ev)   ((ev) & 0x0F)
+
+volatile uint8_t sw3_raw = 0;               // 1 = pressed, written by the main loop
+uint8_t input_state = 0;                    // Debounced, 1 = pressed
+uint8_t input_cnt0 = 0;                     // Vertical counter, bit 0 of each button
+uint8_t input_cnt1 = 0;                     // Vertical counter, bit 1 of each button
+uint8_t input_hold[NB_BUTTONS];             // Ticks held, until the next long / repeat event
+uint8_t input_long = 0;                     // Long press already reported
+uint8_t input_queue[INPUT_QUEUE];
+volatile uint8_t input_head = 0;            // Written by the ISR
+volatile uint8_t input_tail = 0;            // Written by input_pop()
+
+void input_init(void) {
+    DDRD &= ~((1 << DDD2) | (1 << DDD4));   // Set PD2 & PD4 as inputs
+    PORTD |= (1 << PD2) | (1 << PD4);       // Enable internal pull-up resistors for SW1 & SW2
+    TCCR0A = (1 << WGM01);                  // CTC Mode
+    TCCR0B = (1 << CS02) | (1 << CS00);     // Prescaler 1024
+    OCR0A = TOP_TIMER0;
+    TIMSK0 |= (1 << OCIE0A);                // Enable Timer0 Compare Match A Interrupt
+}
+
+void input_push(uint8_t ev) {
+    uint8_t next = (input_head + 1) & (INPUT_QUEUE - 1);
+    if (next == input_tail)
+        return ;                            // Full : the oldest events are kept
+    input_queue[input_head] = ev;
+    input_head = next;
+}
+
+uint8_t input_pop(void) {                   // Next event, 0 if none
+    if (input_tail == input_head)
+        return (0);
+    uint8_t ev = input_queue[input_tail];
+    input_tail = (input_tail + 1) & (INPUT_QUEUE - 1);
+    return (ev);
+}
+
+ISR(TIMER0_COMPA_vect) {
+    uint8_t sample = (!(PIND & (1 << PD2)) << BTN_SW1)
+        | (!(PIND & (1 << PD4)) << BTN_SW2) | (sw3_raw << BTN_SW3);
+    uint8_t delta = sample ^ input_state;   // Counters only run while the input differs
+    input_cnt1 = (input_cnt1 ^ input_cnt0) & delta;
+    input_cnt0 = ~input_cnt0 & delta;
+    uint8_t toggle = delta & ~(input_cnt0 | input_cnt1);   // Counted down to 0 : accept
+    input_state ^= toggle;
+
+    for (uint8_t b = 0; b < NB_BUTTONS; b++) {
+        uint8_t mask = 1 << b;
+        if (toggle & mask) {
+            input_push(b | ((input_state & mask) ? EV_PRESS : EV_RELEASE));
+            input_hold[b] = 0;
+            input_long &= ~mask;
+        } else if (input_state & mask) {
+            input_hold[b]++;
+            if (!(input_long & mask) && input_hold[b] == INPUT_LONG_MS / INPUT_TICK_MS) {
+                input_push(b | EV_LONG);
+                input_long |= mask;
+                input_hold[b] = 0;
+            } else if ((input_long & mask) && input_hold[b] == INPUT_REPEAT_MS / INPUT_TICK_MS) {
+                input_push(b | EV_REPEAT);
+                input_hold[b] = 0;
+            }
+        }
+    }
+}
+
+// *********************************************************** COUNTER & LEDS */
+// SW1 / SW3 : +1, SW2 : -1, held : repeat, SW3 long press : back to 0
+uint8_t handle_event(uint8_t ev, uint8_t counter) {
+    uint8_t type = EV_TYPE(ev);
+    uint8_t button = EV_BUTTON(ev);
+    if (type == EV_LONG && button == BTN_SW3)
+        return (0);
+    if (type == EV_PRESS || (type == EV_REPEAT && button != BTN_SW3)
+        || (type == EV_LONG && button != BTN_SW3))
+        return ((button == BTN_SW2) ? counter - 1 : counter + 1);
+    return (counter);
+}
+
 int main() {
     i2c_init();
     write_data(CONF_0, 0b11110001);         // Set input & output ports
     write_data(OUTPUT_0, 0b11111111);       // LEDs off
-    
+    input_init();
+    sei();
+
     uint8_t counter = 0;
-    uint8_t display_value = 0;
-    uint8_t button_state = 0;
-    uint8_t prev_button_state = 1;
+    uint8_t shown = 0xFF;
     while (1) {
-        button_state = read_data(INPUT_0) & 0b00000001;
-        if (!button_state && button_state != prev_button_state) {
-            counter++;
-            write_data(INPUT_0, 0b00000000);       // LEDs on
-            _delay_ms(100);
+        sw3_raw = !(read_data(INPUT_0) & 0b00000001);  // The ISR cannot use the I2C bus
+        uint8_t ev;
+        while ((ev = input_pop()))
+            counter = handle_event(ev, counter);
+        if ((counter & 0b00000111) != shown) {
+            shown = counter & 0b00000111;
+            write_data(OUTPUT_0, (uint8_t)(~shown << 1));   // LEDs D9 - D11, active low
         }
-        prev_button_state = button_state;
-        display_value = ~(counter & 0b00000111);
-        display_value = (display_value << 1);
-        write_data(OUTPUT_0, display_value);
     }
     return (0);
 }
@@ -1,9 +1,10 @@
 #include <avr/io.h>
 #include <util/delay.h>
+#include <avr/interrupt.h>
 
-// Low-pass filter constant (between 0 and 1)
-// 90% weight to the current new_value & 10% weight to the previous smoothed value
-#define ALPHA 0.95
+// Low-pass filter on the potentiometer : EMA with alpha = 1 / 2^POT_FILTER_SHIFT
+// 50% weight to the current new_value & 50% weight to the previous smoothed value
+#define POT_FILTER_SHIFT 1
 #define SLA_ADDR    0x20
 #define SLA_R       ((SLA_ADDR << 1) | 1)   // 0x71 = 8-bit address for read
 #define SLA_W       (SLA_ADDR << 1) | 0     // 0x70 = 8-bit address for write
@@ -18,11 +19,36 @@
 #define DP3         0b10111111
 #define DP4         0b01111111
 
+#define TOP_TIMER0 (F_CPU / 64UL / 1000 - 1)  // 1ms interrupt period = 249
+#define UART_BAUDRATE 115200
+#define BAUD_TOL_16 35                      // Max baud rate error, per mille, normal / U2X0 mode :
+#define BAUD_TOL_8  30                      // 8N1 max receiver error (4.5% / 4.0%) - 1% for the peer, a
+                                            // crystal USB bridge. Error rounded up, must stay below
+#define UBRR_N(div) ((F_CPU + (div) / 2 * UART_BAUDRATE) / ((div) * UART_BAUDRATE) - 1)   // Nearest
+#define BAUD_N(div) (F_CPU / ((div) * (UBRR_N(div) + 1)))   // Actual rate, normal (16) or U2X0 (8)
+#define BAUD_ERR(div) (((BAUD_N(div) > UART_BAUDRATE ? BAUD_N(div) - UART_BAUDRATE \
+    : UART_BAUDRATE - BAUD_N(div)) * 1000 + UART_BAUDRATE - 1) / UART_BAUDRATE)
+#if BAUD_ERR(8) < BAUD_ERR(16)              // 115200 : U2X0, UBRR 16, +2.1% (normal : UBRR 8, -3.5%)
+#define UART_U2X 1
+#define MYUBRR UBRR_N(8)
+#else
+#define UART_U2X 0
+#define MYUBRR UBRR_N(16)
+#endif
+#if BAUD_ERR(UART_U2X ? 8 : 16) >= (UART_U2X ? BAUD_TOL_8 : BAUD_TOL_16)
+#error "UART_BAUDRATE cannot be reached from F_CPU within BAUD_TOL_16 / BAUD_TOL_8"
+#endif
+#define DISPLAY_MS  4                       // One digit per run : 4 digits = 62Hz refresh
+#define POT_MS      20                      // Potentiometer sampling period
+#define STATS_MS    2000                    // Task statistics over UART
+
 uint32_t d1 = 0;
 uint32_t d2 = 0;
 uint32_t d3 = 0;
 uint32_t d4 = 0;
 
+uint8_t digit = 0;                          // Digit being displayed
+
 uint8_t segments[10] = {
     0b00111111, // 0
     0b00000110, // 1
@@ -36,6 +62,166 @@ uint8_t segments[10] = {
     0b01101111  // 9
 };
 
+// ************************************************************** UART SETUP */
+void uart_init() {
+    UBRR0H = (unsigned char)(MYUBRR >> 8);  // Set baud rate in 16-bit USART Baud Rate Register
+    UBRR0L = (unsigned char)MYUBRR;
+    UCSR0A = (UART_U2X << U2X0);            // Double speed when it is closer to the rate
+    UCSR0B = (1 << TXEN0);                  // Enable transmitter
+    UCSR0C = (1 << UCSZ00) | (1 << UCSZ01); // Set frame format to 8N1 (8-bit frame, 1 stop bit, no parity)
+}
+
+void uart_tx(const char c) {
+    while (!(UCSR0A & (1 << UDRE0)))        // Wait for empty transmit buffer (if 0, buffer = full)
+        ;
+    UDR0 = c;                               // Put data into buffer, sends data
+}
+
+void uart_printstr(const char *str) {
+    while (*str)
+        uart_tx(*str++);
+}
+
+void uart_printnbr(uint32_t n) {
+    char buf[11];
+    uint8_t i = 0;
+    do {
+        buf[i++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    while (i)
+        uart_tx(buf[--i]);
+}
+
+// ************************************************************* SYSTEM TICK */
+volatile uint16_t ms_ticks = 0;
+
+void timer0_init(void) {
+    TCCR0A = (1 << WGM01);                  // CTC Mode
+    TCCR0B = (1 << CS01) | (1 << CS00);     // Prescaler 64 : 1 count = 4us
+    OCR0A = TOP_TIMER0;                     // Interrupt every 1ms
+    TIMSK0 |= (1 << OCIE0A);                // Enable Timer0 Compare Match A Interrupt
+}
+
+ISR(TIMER0_COMPA_vect) {
+    ms_ticks++;
+}
+
+uint16_t millis(void) {
+    uint16_t now;
+    cli();                                  // 16-bit read must not be torn by the ISR
+    now = ms_ticks;
+    sei();
+    return (now);
+}
+
+#define MICROS_WRAP 65536000UL              // micros() period : 2^16 ms, not 2^32 us
+
+uint32_t micros(void) {                     // 4us resolution, wraps after 65s like millis()
+    uint16_t ms;
+    uint8_t count;
+    cli();
+    ms = ms_ticks;
+    count = TCNT0;
+    if ((TIFR0 & (1 << OCF0A)) && count < TOP_TIMER0)
+        ms++;                               // Compare match pending : the tick is not counted yet
+    sei();
+    return ((uint32_t)ms * 1000 + count * 4);
+}
+
+uint32_t micros_since(uint32_t start) {    // Elapsed us, across the MICROS_WRAP wrap
+    uint32_t end = micros();
+    uint32_t elapsed = end - start;
+    if (end < start)
+        elapsed += MICROS_WRAP;
+    return (elapsed);
+}
+
+// *************************************************************** SCHEDULER */
+// Cooperative : tasks run to completion from sched_run() in the main loop, so a task must
+// never wait (no _delay_ms). A task is due when millis() reaches `next` :
+// - periodic (period > 0) : next += period, without drift ; a run started more than
+//   `deadline` ms late counts as a miss, a whole period behind is skipped, not queued
+// - one-shot (period = 0) : runs once, then its slot is free again
+// Statistics per task : runs, worst runtime (us), worst lateness (ms), deadline misses ;
+// stats_task also prints the share of time spent asleep in sched_idle().
+#define SCHED_MAX_TASKS 8
+
+typedef struct {
+    const char *name;
+    void (*fn)(void);
+    uint16_t period;                        // ms, 0 = one-shot
+    uint16_t next;                          // millis() of the next run
+    uint16_t deadline;                      // Allowed start lateness, ms
+    uint16_t runs;
+    uint16_t max_run;                       // us
+    uint16_t max_late;                      // ms
+    uint16_t misses;
+} task_t;
+
+task_t tasks[SCHED_MAX_TASKS];
+
+// Returns the task slot, or -1 if the table is full
+int8_t sched_add(const char *name, void (*fn)(void), uint16_t delay, uint16_t period,
+    uint16_t deadline) {
+    for (uint8_t j = 0; j < SCHED_MAX_TASKS; j++) {
+        if (tasks[j].fn)
+            continue;
+        task_t *t = &tasks[j];
+        t->name = name;
+        t->period = period;
+        t->next = millis() + delay;
+        t->deadline = deadline;
+        t->runs = t->max_run = t->max_late = t->misses = 0;
+        t->fn = fn;                         // Last : the slot becomes active
+        return (j);
+    }
+    return (-1);
+}
+
+uint8_t sched_run(void) {                   // Runs every due task once, returns how many ran
+    uint8_t ran = 0;
+    for (uint8_t j = 0; j < SCHED_MAX_TASKS; j++) {
+        task_t *t = &tasks[j];
+        if (!t->fn)
+            continue;
+        uint16_t late = millis() - t->next;
+        if ((int16_t)late < 0)
+            continue;                       // Not due yet
+        void (*fn)(void) = t->fn;
+        if (t->period) {
+            t->next += t->period;
+            if (late >= t->period)          // Overrun : resync instead of bursting
+                t->next = millis() + t->period;
+        } else
+            t->fn = 0;                      // One-shot : free the slot (fn may add it again)
+        uint32_t start = micros();
+        fn();
+        ran++;
+        uint32_t run = micros_since(start);
+        t->runs++;
+        if (run > t->max_run)
+            t->max_run = (run > 0xFFFF) ? 0xFFFF : run;
+        if (late > t->max_late)
+            t->max_late = late;
+        if (late > t->deadline)
+            t->misses++;
+    }
+    return (ran);
+}
+
+uint32_t sched_sleep_us = 0;                // Time asleep in sched_idle(), reset by stats_task
+
+void sched_idle(void) {                     // Nothing due : sleep until the next 1ms tick
+    uint32_t start = micros();              // The tick ISR (a few us) counts as asleep
+    cli();
+    SMCR = (1 << SE);                       // Idle mode : Timer0 & TWI keep running
+    sei();                                  // sei executes the next instruction first :
+    __asm__ __volatile__ ("sleep");         // the tick cannot slip in before the sleep
+    SMCR = 0;
+    sched_sleep_us += micros_since(start);
+}
+
 // *************************************************************** ADC SETUP */
 void adc_init(void) {
     ADMUX = (1 << REFS0);                   // Set AVCC voltage reference
@@ -108,7 +294,6 @@ void clear_DP(uint8_t dp) {
     write_data(CONF_1, 0b11111111);         // Set all segments as inputs
     write_data(OUTPUT_0, dp);               // Set DP3 off
     write_data(CONF_0, 0b11111111);         // Set DP3 as input
-    _delay_ms(1);
 }
 
 void set_DP(uint8_t num, uint8_t dp) {
@@ -116,18 +301,15 @@ void set_DP(uint8_t num, uint8_t dp) {
     write_data(OUTPUT_0, dp);               // Set DP3 as output (off)
     write_data(CONF_1, 0b10000000);         // Set all segments as outputs
     write_data(OUTPUT_1, num);              // Set number to display
-    _delay_ms(1);
 }
 
-void display() {
-    set_DP(segments[d1], DP1);
-    clear_DP(DP1);
-    set_DP(segments[d2], DP2);
-    clear_DP(DP2);
-    set_DP(segments[d3], DP3);
-    clear_DP(DP3);
-    set_DP(segments[d4], DP4);
-    clear_DP(DP4);
+const uint8_t digits_dp[4] = {DP1, DP2, DP3, DP4};
+
+void display_task(void) {                   // One digit per run, lit until the next run
+    uint8_t value[4] = {d1, d2, d3, d4};
+    clear_DP(digits_dp[digit]);
+    digit = (digit + 1) & 0x03;
+    set_DP(segments[value[digit]], digits_dp[digit]);
 }
 
 void set_value(uint32_t i) {
@@ -137,25 +319,150 @@ void set_value(uint32_t i) {
     d4 = i % 10;
 }
 
-uint16_t low_pass_filter(uint16_t new_value, uint16_t prev_value) {
-    return (uint16_t)(ALPHA * new_value + (1 - ALPHA) * prev_value);
+// ***************************************************************** FILTERS */
+// Per-channel smoothing, integer only :
+// - FILTER_AVERAGE : moving average over `size` samples, running sum updated in O(1)
+// - FILTER_MEDIAN  : median of the last `size` samples (rejects isolated spikes)
+// - FILTER_EMA     : exponential moving average, alpha = 1 / 2^shift
+#define FILTER_MAX_SIZE 8
+
+typedef uint16_t sample_t;                 // 10-bit ADC values
+typedef uint32_t acc_t;
+
+typedef enum {
+    FILTER_NONE,
+    FILTER_AVERAGE,
+    FILTER_MEDIAN,
+    FILTER_EMA
+} filter_mode_t;
+
+typedef struct {
+    filter_mode_t mode;
+    uint8_t size;                           // Window length (AVERAGE / MEDIAN)
+    uint8_t shift;                          // Alpha shift (EMA)
+    uint8_t head;                           // Next slot to overwrite in the circular buffer
+    uint8_t count;                          // Samples received, saturates at size
+    acc_t sum;                              // Running sum of the window (AVERAGE), value << shift (EMA)
+    sample_t window[FILTER_MAX_SIZE];
+} filter_t;
+
+void filter_init(filter_t *f, filter_mode_t mode, uint8_t param) {
+    f->mode = mode;
+    f->size = 1;
+    f->shift = 0;
+    if (mode == FILTER_EMA)
+        f->shift = param;
+    else if (mode != FILTER_NONE)
+        f->size = (param == 0 || param > FILTER_MAX_SIZE) ? FILTER_MAX_SIZE : param;
+    f->head = 0;
+    f->count = 0;
+    f->sum = 0;
+}
+
+uint8_t filter_ready(const filter_t *f) {   // Window full : output is meaningful
+    return (f->count >= f->size);
+}
+
+sample_t filter_median(const filter_t *f) {
+    sample_t sorted[FILTER_MAX_SIZE];
+    for (uint8_t j = 0; j < f->count; j++) {  // Insertion sort, N <= FILTER_MAX_SIZE
+        sample_t v = f->window[j];
+        uint8_t k = j;
+        while (k > 0 && sorted[k - 1] > v) {
+            sorted[k] = sorted[k - 1];
+            k--;
+        }
+        sorted[k] = v;
+    }
+    return (sorted[(f->count - 1) / 2]);
+}
+
+filter_t pot_filter;
+
+sample_t filter_push(filter_t *f, sample_t value) {
+    switch (f->mode) {
+        case FILTER_AVERAGE:
+            if (f->count == f->size)
+                f->sum -= f->window[f->head]; // Drop the oldest sample from the running sum
+            else
+                f->count++;
+            f->window[f->head] = value;
+            f->sum += value;
+            f->head = (f->head + 1 == f->size) ? 0 : f->head + 1;
+            return (f->sum / f->count);
+        case FILTER_MEDIAN:
+            if (f->count < f->size)
+                f->count++;
+            f->window[f->head] = value;
+            f->head = (f->head + 1 == f->size) ? 0 : f->head + 1;
+            return (filter_median(f));
+        case FILTER_EMA:
+            if (f->count == 0) {
+                f->count = 1;
+                f->sum = (acc_t)value << f->shift;  // Start from the first sample, not from 0
+            } else                              // Signed : a 16-bit difference wraps when value < average
+                f->sum += (int32_t)value - (int32_t)(f->sum >> f->shift);
+            return (f->sum >> f->shift);
+        default:
+            f->count = 1;
+            return (value);
+    }
+}
+
+// ******************************************************************* TASKS */
+void pot_task(void) {
+    uint16_t adc_value = adc_read();        // Get raw ADC value
+    uint16_t filtered_value = filter_push(&pot_filter, adc_value);  // Apply filter
+    if (adc_value == 1023)
+        set_value(1023);
+    else
+        set_value(filtered_value);          // Set the value to display
+}
+
+uint32_t stats_start = 0;                   // micros() of the previous report
+
+void stats_task(void) {
+    uint32_t total = micros_since(stats_start);
+    stats_start += total;
+    if (stats_start >= MICROS_WRAP)
+        stats_start -= MICROS_WRAP;
+    uart_printstr("asleep ");
+    uart_printnbr(sched_sleep_us / (total / 100));
+    uart_printstr("%\r\n");
+    sched_sleep_us = 0;
+    uart_printstr("task      runs  max us  max late ms  misses\r\n");
+    for (uint8_t j = 0; j < SCHED_MAX_TASKS; j++) {
+        task_t *t = &tasks[j];
+        if (!t->fn)
+            continue;
+        uart_printstr(t->name);
+        uart_printstr("  ");
+        uart_printnbr(t->runs);
+        uart_printstr("  ");
+        uart_printnbr(t->max_run);
+        uart_printstr("  ");
+        uart_printnbr(t->max_late);
+        uart_printstr("  ");
+        uart_printnbr(t->misses);
+        uart_printstr("\r\n");
+    }
 }
 
 int main() {
     i2c_init();
     adc_init();
-    uint16_t filtered_value = 0;
+    uart_init();
+    timer0_init();
+    sei();
+    filter_init(&pot_filter, FILTER_EMA, POT_FILTER_SHIFT);
     set_value(adc_read());
+    sched_add("display", display_task, 0, DISPLAY_MS, DISPLAY_MS);
+    sched_add("pot    ", pot_task, 1, POT_MS, POT_MS / 2);
+    sched_add("stats  ", stats_task, STATS_MS, STATS_MS, STATS_MS);
+    PRR = (1 << PRTIM1) | (1 << PRTIM2) | (1 << PRSPI);     // Unused : Timer1, Timer2, SPI
     while (1) {
-        display();
-        uint16_t adc_value = adc_read();  // Get raw ADC value
-        display();
-        filtered_value = low_pass_filter(adc_value, filtered_value);  // Apply filter
-        if (adc_value == 1023)
-            set_value(1023);
-        else
-            set_value(filtered_value);  // Set the value to display
-        display();
+        if (!sched_run())
+            sched_idle();
     }
     return (0);
 }
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+# Host check of the FILTERS section of main.c : the section is compiled with the
+# host C compiler and fed ramps and steps, upward and downward. Every filter must
+# stay within the input range and settle on the final input value.
+#
+# AVR int is 16-bit : a uint16_t difference wraps before it reaches the 32-bit
+# accumulator. The section is also built with sample_t / acc_t widened to
+# uint32_t / uint64_t, so the host int has the same width ratio and hits the
+# same wrap.
+#
+#   python3 test_filters.py [main.c]        -> exit status 0 if all checks pass
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+CC = os.environ.get("CC", "cc")
+ADC_MAX = 1023
+SETTLE = 64                                 # Samples held at the final value
+TOLERANCE = 1 << 3                          # EMA truncation : value - average < 2^shift
+
+HARNESS = r"""
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+%s
+
+int main(int argc, char **argv) {
+    static const filter_mode_t modes[] = {FILTER_AVERAGE, FILTER_MEDIAN, FILTER_EMA};
+    static const uint8_t params[] = {4, 5, 3};
+    for (int m = 0; m < 3; m++) {
+        filter_t f;
+        filter_init(&f, modes[m], params[m]);
+        printf("%%d", m);
+        for (int i = 1; i < argc; i++)
+            printf(" %%lu", (unsigned long)filter_push(&f, (sample_t)atoi(argv[i])));
+        printf("\n");
+    }
+    return (0);
+}
+"""
+
+MODES = ["FILTER_AVERAGE", "FILTER_MEDIAN", "FILTER_EMA"]
+
+
+def load_section(path):
+    src = open(path).read()
+    body = re.search(r"^// \*+ FILTERS \*/\n(.*?)^// \*+ \w+ \*/", src, re.S | re.M)
+    if not body:
+        raise ValueError("FILTERS section not found in %s" % path)
+    return body.group(1)
+
+
+def widen(section):
+    out = re.sub(r"typedef uint16_t sample_t;", "typedef uint32_t sample_t;", section)
+    out = re.sub(r"typedef uint32_t acc_t;", "typedef uint64_t acc_t;", out)
+    if out == section:
+        raise ValueError("sample_t / acc_t typedefs not found")
+    return out
+
+
+def build(section, tmp, name):
+    c_path = os.path.join(tmp, name + ".c")
+    exe = os.path.join(tmp, name)
+    with open(c_path, "w") as f:
+        f.write(HARNESS % section)
+    subprocess.run([CC, "-std=c99", "-Wall", "-o", exe, c_path], check=True)
+    return exe
+
+
+def sequences():
+    down = list(range(ADC_MAX, -1, -7)) + [0] * SETTLE
+    up = list(range(0, ADC_MAX + 1, 7)) + [ADC_MAX] * SETTLE
+    step_down = [ADC_MAX] * 16 + [0] * SETTLE
+    step_mid = [800] * 16 + [100] * SETTLE + [600] * SETTLE
+    return [("ramp down", down), ("ramp up", up),
+            ("step down", step_down), ("steps", step_mid)]
+
+
+def check(exe, label):
+    errors = 0
+    for name, seq in sequences():
+        out = subprocess.run([exe] + [str(v) for v in seq], check=True,
+                             capture_output=True, text=True).stdout.split("\n")
+        for line in filter(None, out):
+            fields = [int(v) for v in line.split()]
+            mode, values = MODES[fields[0]], fields[1:]
+            lo, hi = min(seq), max(seq)
+            bad = [i for i, v in enumerate(values) if not lo <= v <= hi]
+            if bad:
+                sys.stderr.write("%s %s %s : output %d out of [%d, %d] at sample %d\n"
+                                 % (label, mode, name, values[bad[0]], lo, hi, bad[0]))
+                errors += 1
+            elif abs(values[-1] - seq[-1]) >= TOLERANCE:
+                sys.stderr.write("%s %s %s : settled on %d, expected %d\n"
+                                 % (label, mode, name, values[-1], seq[-1]))
+                errors += 1
+    return errors
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else \
+        os.path.join(os.path.dirname(os.path.abspath(__file__)), "main.c")
+    section = load_section(path)
+    errors = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        errors += check(build(section, tmp, "filters"), "native")
+        errors += check(build(widen(section), tmp, "filters_wide"), "16-bit int")
+    print("%s : %d error(s)" % (os.path.basename(path), errors))
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())